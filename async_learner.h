@@ -0,0 +1,266 @@
+#ifndef ASYNC_LEARNER_H
+#define ASYNC_LEARNER_H
+
+#include "batch_prefetcher.h"
+#include "dqn.h"
+#include "policy_kernel.h"
+#include "replay_buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Policy weights handed from the learner to the actors in two flat buffers (the layout of
+// DQN::read_parameters). The learner fills the back buffer without a lock, then flips it to the
+// front under a short lock; actors only ever copy the front buffer, under the same lock, into
+// their own PolicyKernel. A flip waits for a copy in progress, so neither side sees a
+// half-written set of weights.
+class PolicySnapshot {
+public:
+    PolicySnapshot(int state_size, int hidden_size, int action_size, size_t parameter_count)
+        : in_(state_size), hidden_(hidden_size), out_(action_size) {
+        buffers_[0].assign(parameter_count, 0.0f);
+        buffers_[1].assign(parameter_count, 0.0f);
+    }
+
+    PolicySnapshot(const PolicySnapshot&) = delete;
+    PolicySnapshot& operator=(const PolicySnapshot&) = delete;
+
+    // Publisher side: fill back(), then Publish(). Single publisher.
+    float* back() { return buffers_[1 - front_].data(); }
+
+    void Publish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        front_ = 1 - front_;
+        version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Snapshots published so far.
+    uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+    // Reloads kernel if a snapshot newer than `version` was published, updating `version`.
+    // Costs one atomic load when there is nothing new.
+    bool Refresh(PolicyKernel& kernel, uint64_t& version) {
+        if (version_.load(std::memory_order_acquire) == version) return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        kernel.LoadFlat(in_, hidden_, out_, buffers_[front_].data());
+        version = version_.load(std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    int in_, hidden_, out_;
+    std::vector<float> buffers_[2];
+    std::mutex mutex_; // guards front_ flips against readers.
+    int front_ = 0;
+    std::atomic<uint64_t> version_{0};
+};
+
+// Trains the DQN on its own thread, continuously, from the replay buffer the env loop keeps
+// filling, so simulation and learning overlap instead of the env loop blocking on train().
+// Every `publish_every` updates the policy weights go out through a PolicySnapshot; actors act
+// on their own kernel refreshed from it and never touch the DQN while the learner runs.
+//
+// Batches come from the BatchPrefetcher when one is given, otherwise the learner samples
+// itself. Either way the env loop must hold mutex() around every replay add. Anything else
+// that touches the DQN (learning rate, save, evaluation) goes between Pause() and Resume().
+//
+// max_replay_ratio > 0 caps the sampled transitions per transition added since Start()
+// (updates * batch_size / actor steps): the learner waits for the actors instead of
+// overfitting a buffer that is filling slower than it trains. 0 lets it run free.
+class AsyncLearner {
+public:
+    struct Stats {
+        long long updates = 0;
+        long long published = 0; // snapshots published (including the initial one).
+        double lossSum = 0.0; // sum of update losses.
+        double trainSeconds = 0.0; // time in sampling and updates.
+        double throttleSeconds = 0.0; // time waiting on the replay ratio cap.
+    };
+
+    AsyncLearner(DQN& dqn, ReplayBuffer& buffer, int batch_size, bool prioritized, int publish_every,
+                 float max_replay_ratio = 0.0f, BatchPrefetcher* prefetcher = nullptr)
+        : dqn_(dqn), buffer_(buffer), prefetcher_(prefetcher), batchSize_(batch_size),
+          prioritized_(prioritized), publishEvery_(publish_every > 0 ? publish_every : 1),
+          maxReplayRatio_(max_replay_ratio),
+          snapshot_(dqn.state_size(), dqn.hidden_size(), dqn.action_size(), dqn.parameter_count()) {
+        if (!prefetcher_) batch_.allocate(batch_size, dqn.state_size(), dqn.device());
+        Publish();
+    }
+
+    ~AsyncLearner() { Stop(); }
+
+    AsyncLearner(const AsyncLearner&) = delete;
+    AsyncLearner& operator=(const AsyncLearner&) = delete;
+
+    // Starts the learner (and the prefetcher). The buffer must already hold a batch.
+    void Start() {
+        if (worker_.joinable()) return;
+        if (prefetcher_) prefetcher_->Start();
+        actorSteps_.store(0, std::memory_order_relaxed);
+        startUpdates_ = updates_.load(std::memory_order_relaxed);
+        stop_ = false;
+        worker_ = std::thread([this]() { Run(); });
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+
+    bool running() const { return worker_.joinable(); }
+    int publish_every() const { return publishEvery_; }
+
+    // Guards the replay buffer against the learner's (or prefetcher's) sampling.
+    std::mutex& mutex() { return prefetcher_ ? prefetcher_->mutex() : buffer_mutex_; }
+
+    PolicySnapshot& snapshot() { return snapshot_; }
+
+    // Importance-sampling exponent for batches sampled from now on.
+    void SetBeta(float beta) {
+        beta_.store(beta, std::memory_order_relaxed);
+        if (prefetcher_) prefetcher_->SetBeta(beta);
+    }
+
+    // Env transitions added since Start(); feeds the replay ratio cap. Wakes the learner if it is
+    // waiting on the cap (only then does this take the lock).
+    void AddActorSteps(long long steps) {
+        actorSteps_.fetch_add(steps, std::memory_order_seq_cst);
+        if (!throttled_.load(std::memory_order_seq_cst)) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        cv_.notify_all();
+    }
+
+    long long updates() const { return updates_.load(std::memory_order_relaxed); }
+
+    // Blocks until the learner is parked between updates; the caller may then use the DQN.
+    void Pause() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        paused_ = true;
+        if (!worker_.joinable()) return;
+        cv_.notify_all(); // a learner waiting on the replay ratio cap parks instead.
+        cv_.wait(lock, [this]() { return parked_; });
+    }
+
+    void Resume() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            paused_ = false;
+        }
+        cv_.notify_all();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    void Publish() {
+        dqn_.read_parameters(snapshot_.back());
+        snapshot_.Publish();
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.published++;
+    }
+
+    // True if one more update would push the replay ratio over the cap.
+    bool AheadOfActors(long long done) const {
+        return maxReplayRatio_ > 0.0f && (double)(done + 1 - startUpdates_) * batchSize_ >
+                                             (double)maxReplayRatio_ * actorSteps_.load(std::memory_order_seq_cst);
+    }
+
+    void Run() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (paused_) {
+                    parked_ = true;
+                    cv_.notify_all();
+                    cv_.wait(lock, [this]() { return stop_ || !paused_; });
+                    parked_ = false;
+                }
+                if (stop_) return;
+            }
+
+            const long long done = updates_.load(std::memory_order_relaxed);
+            if (AheadOfActors(done)) {
+// Sleep until AddActorSteps brings the ratio back under the cap (or Pause/Stop). throttled_ is
+// set before the steps are re-read, so an add either lands before that read or sees the flag
+// and notifies under the lock.
+                auto start = std::chrono::steady_clock::now();
+                std::unique_lock<std::mutex> lock(mutex_);
+                throttled_.store(true, std::memory_order_seq_cst);
+                cv_.wait(lock, [this, done]() { return stop_ || paused_ || !AheadOfActors(done); });
+                throttled_.store(false, std::memory_order_relaxed);
+                stats_.throttleSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            float loss;
+            if (prefetcher_) {
+                DQN::TrainBatch& ready = prefetcher_->Acquire();
+                loss = dqn_.train(ready, prioritized_);
+                if (prioritized_) prefetcher_->UpdatePriorities(ready);
+                prefetcher_->Release();
+            } else {
+                {
+                    std::lock_guard<std::mutex> lock(buffer_mutex_);
+                    buffer_.sample(batch_.view(), beta_.load(std::memory_order_relaxed));
+                    batch_.generation = buffer_.added();
+                }
+                loss = dqn_.train(batch_, prioritized_);
+                if (prioritized_) {
+                    std::lock_guard<std::mutex> lock(buffer_mutex_);
+                    buffer_.update_priorities(batch_.indices.data(), batch_.td_errors.data_ptr<float>(), batch_.size,
+                                              batch_.generation);
+                }
+            }
+            updates_.store(done + 1, std::memory_order_relaxed);
+            if ((done + 1) % publishEvery_ == 0) Publish();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.updates = done + 1;
+            stats_.lossSum += loss;
+            stats_.trainSeconds += seconds;
+        }
+    }
+
+    DQN& dqn_;
+    ReplayBuffer& buffer_;
+    BatchPrefetcher* prefetcher_;
+    int batchSize_;
+    bool prioritized_;
+    int publishEvery_;
+    float maxReplayRatio_;
+    DQN::TrainBatch batch_; // learner thread only (unused with a prefetcher).
+    std::mutex buffer_mutex_;
+    std::atomic<float> beta_{1.0f};
+    std::atomic<long long> actorSteps_{0};
+    std::atomic<bool> throttled_{false}; // learner is waiting on the replay ratio cap.
+    std::atomic<long long> updates_{0};
+    long long startUpdates_ = 0; // updates_ at Start().
+    PolicySnapshot snapshot_;
+
+    mutable std::mutex mutex_; // guards everything below.
+    std::condition_variable cv_;
+    bool paused_ = false;
+    bool parked_ = false;
+    bool stop_ = false;
+    Stats stats_;
+
+    std::thread worker_;
+};
+
+#endif // ASYNC_LEARNER_H
@@ -0,0 +1,156 @@
+#ifndef BATCH_PREFETCHER_H
+#define BATCH_PREFETCHER_H
+
+#include "dqn.h"
+#include "replay_buffer.h"
+#include "rng.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Samples training batches on a worker thread while the learner runs gradient steps.
+// The worker keeps up to `depth` batches ready in a ring of depth + 1 persistent TrainBatch
+// slots (the extra one is the batch the learner is training on), writing rows straight into
+// the slot tensors. The replay buffer is shared with the env loop: every add and priority
+// update must hold mutex() while the prefetcher is running.
+//
+// Stall metrics tell which side is the bottleneck: learner wait time means the learner is
+// sample-bound, worker idle time (all slots full) means it is compute-bound.
+class BatchPrefetcher {
+public:
+    struct Stats {
+        long long batches = 0; // batches handed to the learner.
+        long long stalls = 0; // acquires that found no batch ready.
+        double stallSeconds = 0.0; // learner time spent waiting for a batch.
+        double sampleSeconds = 0.0; // worker time spent sampling (including buffer lock waits).
+        double idleSeconds = 0.0; // worker time spent waiting for a free slot.
+    };
+
+    BatchPrefetcher(ReplayBuffer& buffer, int batch_size, int state_size, int depth,
+                    torch::Device device = torch::kCPU, uint64_t seed = 0)
+        : buffer_(buffer), slots_(depth + 1), rng_(seed, RNG_STREAM_PREFETCH) {
+        for (DQN::TrainBatch& slot : slots_) slot.allocate(batch_size, state_size, device);
+    }
+
+    ~BatchPrefetcher() { Stop(); }
+
+    BatchPrefetcher(const BatchPrefetcher&) = delete;
+    BatchPrefetcher& operator=(const BatchPrefetcher&) = delete;
+
+    // Starts the worker. The buffer must already hold at least one batch worth of transitions.
+    void Start() {
+        if (worker_.joinable()) return;
+        stop_ = false;
+        worker_ = std::thread([this]() { Run(); });
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+
+    bool running() const { return worker_.joinable(); }
+    int depth() const { return (int)slots_.size() - 1; }
+
+    // Guards the replay buffer against the worker's sampling.
+    std::mutex& mutex() { return buffer_mutex_; }
+
+    // Importance-sampling exponent for batches sampled from now on.
+    void SetBeta(float beta) { beta_.store(beta, std::memory_order_relaxed); }
+
+    // Next ready batch (blocks if none is). Hand it back with Release after training on it.
+    DQN::TrainBatch& Acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (ready_ == 0) {
+            auto start = std::chrono::steady_clock::now();
+            stats_.stalls++;
+            cv_.wait(lock, [this]() { return ready_ > 0; });
+            stats_.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        ready_--;
+        inUse_ = true;
+        stats_.batches++;
+        return slots_[head_];
+    }
+
+    void Release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            head_ = (head_ + 1) % (int)slots_.size();
+            inUse_ = false;
+        }
+        cv_.notify_all();
+    }
+
+    // Priority refresh from the acquired batch's TD errors (prioritized replay); slots
+    // overwritten or evicted since the batch was sampled are left alone.
+    void UpdatePriorities(DQN::TrainBatch& batch) {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        buffer_.update_priorities(batch.indices.data(), batch.td_errors.data_ptr<float>(), batch.size,
+                                  batch.generation);
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    void Run() {
+        const int count = (int)slots_.size();
+        while (true) {
+            int slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                auto start = std::chrono::steady_clock::now();
+                cv_.wait(lock, [this, count]() { return stop_ || ready_ + (inUse_ ? 1 : 0) < count; });
+                stats_.idleSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (stop_) return;
+                slot = tail_;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> lock(buffer_mutex_);
+                buffer_.sample(slots_[slot].view(), beta_.load(std::memory_order_relaxed), rng_);
+                slots_[slot].generation = buffer_.added();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stats_.sampleSeconds += seconds;
+                tail_ = (tail_ + 1) % count;
+                ready_++;
+            }
+            cv_.notify_all();
+        }
+    }
+
+    ReplayBuffer& buffer_;
+    std::vector<DQN::TrainBatch> slots_;
+    std::mutex buffer_mutex_;
+    std::atomic<float> beta_{1.0f};
+    Rng rng_; // worker thread only.
+
+    mutable std::mutex mutex_; // guards everything below.
+    std::condition_variable cv_;
+    int head_ = 0; // next slot for the learner.
+    int tail_ = 0; // next slot for the worker.
+    int ready_ = 0;
+    bool inUse_ = false;
+    bool stop_ = false;
+    Stats stats_;
+
+    std::thread worker_;
+};
+
+#endif // BATCH_PREFETCHER_H
@@ -0,0 +1,163 @@
+#ifndef CONCURRENT_REPLAY_BUFFER_H
+#define CONCURRENT_REPLAY_BUFFER_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+#include "replay_buffer.h"
+#include "rng.h"
+
+// Multi-producer replay buffer: any number of actor threads add transitions and any number of
+// learner threads sample, without a lock.
+//
+// An add reserves ticket t with one fetch_add on the shared cursor; ticket t owns slot
+// t % capacity. Each slot has a sequence marker: 0 while empty, 2t + 1 while ticket t writes
+// it, 2t + 2 once ticket t is published. A writer only waits when it laps the ring before the
+// previous owner of its slot (ticket t - capacity) has published, which needs capacity
+// concurrent adds in flight.
+//
+// Sampling reads a slot's marker, copies the row, then reads the marker again (seqlock): a
+// slot that was unpublished, or rewritten during the copy, is rejected and another slot is
+// drawn, so a batch only ever holds fully published transitions. Readers never write shared
+// memory, so they do not slow the producers down.
+//
+// A reader may copy a row while a writer overwrites it, so the payload is stored as atomics
+// and copied element by element with relaxed loads and stores. That is a plain mov on x86,
+// and it keeps the torn copy (discarded by the marker check) free of data races.
+//
+// Pair storage and uniform sampling only: frame chaining and priorities both need ordered,
+// exclusive updates, which is what this buffer removes.
+class ConcurrentReplayBuffer {
+public:
+    ConcurrentReplayBuffer(int capacity, int state_size)
+        : capacity_(capacity),
+          state_size_(state_size),
+          states_((size_t)capacity * state_size),
+          next_states_((size_t)capacity * state_size),
+          actions_(capacity),
+          rewards_(capacity),
+          dones_(capacity),
+          sequence_(capacity) {
+        for (std::atomic<int64_t>& marker : sequence_) marker.store(0, std::memory_order_relaxed);
+    }
+
+    ConcurrentReplayBuffer(const ConcurrentReplayBuffer&) = delete;
+    ConcurrentReplayBuffer& operator=(const ConcurrentReplayBuffer&) = delete;
+
+    // Add experience (thread-safe). Returns the transition's ticket (its slot is ticket % capacity).
+    int64_t add(const float* state, int action, float reward, const float* next_state, bool done) {
+        const int64_t ticket = cursor_.fetch_add(1, std::memory_order_relaxed);
+        const int slot = (int)(ticket % capacity_);
+        std::atomic<int64_t>& marker = sequence_[slot];
+
+// Wait for the slot's previous owner to publish before overwriting it.
+        const int64_t previous = (ticket >= capacity_) ? 2 * (ticket - capacity_) + 2 : 0;
+        while (marker.load(std::memory_order_acquire) != previous) std::this_thread::yield();
+
+        marker.store(2 * ticket + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const size_t row = (size_t)slot * state_size_;
+        StoreRow(&states_[row], state, state_size_);
+        StoreRow(&next_states_[row], next_state, state_size_);
+        actions_[slot].store(action, std::memory_order_relaxed);
+        rewards_[slot].store(reward, std::memory_order_relaxed);
+        dones_[slot].store(done ? 1 : 0, std::memory_order_relaxed);
+
+        marker.store(2 * ticket + 2, std::memory_order_release);
+        return ticket;
+    }
+
+    // Sample random batch (with replacement) of published transitions, drawing from the
+    // caller's generator (one per sampling thread). Weights are all 1. Returns the number of
+    // slots rejected because they were unpublished or overwritten mid-copy, or -1 (batch left
+    // untouched) if fewer than batch.size slots are reserved.
+    //
+    // Like ReplayBuffer::sample, call it once can_sample(batch.size) holds. A draw that lands on
+    // a reserved but unpublished slot is retried, so while every reserved slot is still being
+    // written the call waits for the first of those adds to publish: sample only while the
+    // producers that reserved them are running (an add in flight always completes).
+    int sample(const ReplayBatchView& batch, Rng& rng) const {
+        const int n = size();
+        if (n == 0 || n < batch.size) return -1;
+        int rejected = 0;
+        for (int i = 0; i < batch.size; i++) {
+            float* state = &batch.states[(size_t)i * state_size_];
+            float* nextState = &batch.next_states[(size_t)i * state_size_];
+            while (true) {
+                const int slot = (int)rng.NextInt((uint32_t)n);
+                const std::atomic<int64_t>& marker = sequence_[slot];
+                const int64_t before = marker.load(std::memory_order_acquire);
+                if (before == 0 || (before & 1)) {
+                    rejected++;
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                const size_t row = (size_t)slot * state_size_;
+                LoadRow(state, &states_[row], state_size_);
+                LoadRow(nextState, &next_states_[row], state_size_);
+                batch.actions[i] = actions_[slot].load(std::memory_order_relaxed);
+                batch.rewards[i] = rewards_[slot].load(std::memory_order_relaxed);
+                batch.dones[i] = (float)dones_[slot].load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (marker.load(std::memory_order_relaxed) != before) {
+                    rejected++;
+                    continue;
+                }
+                batch.indices[i] = slot;
+                batch.weights[i] = 1.0f;
+                if (batch.steps) batch.steps[i] = 1.0f;
+                break;
+            }
+        }
+        return rejected;
+    }
+
+    int sample(int batch_size, ReplayBatch& batch, Rng& rng) const {
+        batch.resize(batch_size, state_size_);
+        return sample(batch.view(), rng);
+    }
+
+    // Slots reserved so far (capped at capacity); a reserved slot may still be being written.
+    int size() const {
+        const int64_t added = cursor_.load(std::memory_order_relaxed);
+        return (added < capacity_) ? (int)added : capacity_;
+    }
+
+    int64_t added() const { return cursor_.load(std::memory_order_relaxed); }
+    int capacity() const { return capacity_; }
+    int state_size() const { return state_size_; }
+    bool can_sample(int batch_size) const { return size() >= batch_size; }
+
+    size_t Bytes() const {
+        return (states_.size() + next_states_.size() + rewards_.size()) * sizeof(float) +
+               actions_.size() * sizeof(int) + dones_.size() + sequence_.size() * sizeof(int64_t);
+    }
+
+private:
+    static void StoreRow(std::atomic<float>* dst, const float* src, int n) {
+        for (int k = 0; k < n; k++) dst[k].store(src[k], std::memory_order_relaxed);
+    }
+
+    static void LoadRow(float* dst, const std::atomic<float>* src, int n) {
+        for (int k = 0; k < n; k++) dst[k] = src[k].load(std::memory_order_relaxed);
+    }
+
+    int capacity_;
+    int state_size_;
+    std::atomic<int64_t> cursor_{0}; // next ticket.
+
+// Payload, written and read as relaxed atomics (see above).
+    std::vector<std::atomic<float>> states_;
+    std::vector<std::atomic<float>> next_states_;
+    std::vector<std::atomic<int>> actions_;
+    std::vector<std::atomic<float>> rewards_;
+    std::vector<std::atomic<uint8_t>> dones_;
+    std::vector<std::atomic<int64_t>> sequence_; // per-slot marker, see above.
+};
+
+#endif // CONCURRENT_REPLAY_BUFFER_H
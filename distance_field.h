@@ -0,0 +1,152 @@
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include "raylib.h"
+#include "surface_grid.h"
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// Euclidean distance-to-nearest-wall field, baked once from the surface grid.
+// Each cell holds the distance (in pixels) from its centre to the centre of the
+// closest wall pixel. Pixels outside the image count as walls, so the field also
+// covers the out-of-bounds exit of a ray. Wall pixels store exactly 0.
+//
+// The ray caster reads a byte table instead: for each cell, how many 2px lattice steps
+// are known to be clear from any point that truncates into it (0 = solid). It is padded
+// like SurfaceGrid so rays need no bounds checks.
+struct DistanceField {
+    static constexpr int PAD = SurfaceGrid::PAD;
+    static constexpr float STEP = 2.0f;
+
+// Clearance margin: a sample can sit up to ~1.6px from the centre of the cell it truncates
+// to (negative coordinates truncate towards zero), plus half a wall pixel's diagonal.
+    static constexpr float MARGIN = 2.5f;
+
+    int width = 0;
+    int height = 0;
+    int stride = 0; // width + 2 * PAD.
+    std::vector<float> dist; // width * height, row-major.
+    std::vector<uint8_t> skip; // stride * (height + 2 * PAD).
+
+    float At(int x, int y) const { return dist[(size_t)y * width + x]; }
+    bool IsWallAt(int x, int y) const { return At(x, y) == 0.0f; }
+
+    uint8_t SkipAt(int x, int y) const { return skip[(size_t)(y + PAD) * stride + (x + PAD)]; }
+};
+
+// 1D squared-distance transform (Felzenszwalb & Huttenlocher, lower envelope of parabolas).
+// f: input costs (0 at sites, large elsewhere), d: output, v/z: scratch of size n and n+1.
+inline void DistanceTransform1D(const float* f, int n, float* d, int* v, float* z) {
+    const float INF = 1e20f;
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INF;
+    z[1] = INF;
+
+    for (int q = 1; q < n; q++) {
+        float s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INF;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; q++) {
+        while (z[k + 1] < q) k++;
+        float dq = (float)(q - v[k]);
+        d[q] = dq * dq + f[v[k]];
+    }
+}
+
+inline DistanceField BuildDistanceField(const SurfaceGrid& surface) {
+    const float INF = 1e20f;
+
+// Work on a grid padded by one wall pixel on every side so the image border acts as a wall.
+    const int W = surface.width + 2;
+    const int H = surface.height + 2;
+    std::vector<float> grid((size_t)W * H, 0.0f);
+
+    for (int y = 0; y < surface.height; y++) {
+        for (int x = 0; x < surface.width; x++) {
+            grid[(size_t)(y + 1) * W + (x + 1)] = IsSolid(surface.At(x, y)) ? 0.0f : INF;
+        }
+    }
+
+    const int N = std::max(W, H);
+    std::vector<float> f(N), d(N), z(N + 1);
+    std::vector<int> v(N);
+
+// Columns, then rows.
+    for (int x = 0; x < W; x++) {
+        for (int y = 0; y < H; y++) f[y] = grid[(size_t)y * W + x];
+        DistanceTransform1D(f.data(), H, d.data(), v.data(), z.data());
+        for (int y = 0; y < H; y++) grid[(size_t)y * W + x] = d[y];
+    }
+    for (int y = 0; y < H; y++) {
+        float* row = &grid[(size_t)y * W];
+        std::copy(row, row + W, f.begin());
+        DistanceTransform1D(f.data(), W, d.data(), v.data(), z.data());
+        std::copy(d.begin(), d.begin() + W, row);
+    }
+
+    DistanceField field;
+    field.width = surface.width;
+    field.height = surface.height;
+    field.dist.resize((size_t)field.width * field.height);
+    for (int y = 0; y < field.height; y++) {
+        for (int x = 0; x < field.width; x++) {
+            field.dist[(size_t)y * field.width + x] = sqrtf(grid[(size_t)(y + 1) * W + (x + 1)]);
+        }
+    }
+
+// Lattice samples strictly closer than (dist - MARGIN) are open, so the next one worth
+// testing is floor((dist - MARGIN) / STEP) steps ahead (at least 1).
+    field.stride = field.width + 2 * DistanceField::PAD;
+    field.skip.assign((size_t)field.stride * (field.height + 2 * DistanceField::PAD), 0);
+    for (int y = 0; y < field.height; y++) {
+        for (int x = 0; x < field.width; x++) {
+            float d = field.At(x, y);
+            uint8_t steps = 0;
+            if (d > 0.0f) {
+                int n = (int)((d - DistanceField::MARGIN) / DistanceField::STEP);
+                steps = (uint8_t)std::min(255, std::max(1, n));
+            }
+            field.skip[(size_t)(y + DistanceField::PAD) * field.stride + (x + DistanceField::PAD)] = steps;
+        }
+    }
+    return field;
+}
+
+// Sphere-traced LIDAR ray over the distance field.
+// Samples stay on the same 2px lattice as the image marcher and every sample that could
+// touch a wall is still tested exactly, so the returned distance is identical to
+// CastLIDARRay(SurfaceGrid) (tolerance: 0). Open stretches are skipped by the stored clearance.
+inline float CastLIDARRay(const DistanceField& field, Vector2 position, float angle, float maxDistance) {
+    float distance = 0.0f;
+    const float step = DistanceField::STEP;
+
+    const auto cosA = cos(angle);
+    const auto sinA = sin(angle);
+
+    while (distance < maxDistance) {
+        float checkX = position.x + cosA * distance;
+        float checkY = position.y + sinA * distance;
+
+        int skip = field.SkipAt((int)checkX, (int)checkY);
+        if (skip == 0) return distance;
+
+        distance += skip * step;
+    }
+
+    return maxDistance;
+}
+
+#endif // DISTANCE_FIELD_H
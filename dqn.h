@@ -1,244 +1,546 @@
-#ifndef DQN_H
-#define DQN_H
-
-#include <torch/torch.h>
-#include <iostream>
-#include <vector>
-#include <string>
-#include <memory>
-#include <thread>
-
-// Simple MLP policy network.
-struct DQNNetImpl : torch::nn::Module {
-    torch::nn::Linear fc1{nullptr}, fc2{nullptr}, fc3{nullptr};
-
-    DQNNetImpl(int64_t state_size, int64_t action_size) {
-        fc1 = register_module("fc1", torch::nn::Linear(state_size, 64));
-        fc2 = register_module("fc2", torch::nn::Linear(64, 64));
-        fc3 = register_module("fc3", torch::nn::Linear(64, action_size));
-    }
-
-    torch::Tensor forward(torch::Tensor x) {
-        x = torch::relu(fc1->forward(x));
-        x = torch::relu(fc2->forward(x));
-        x = fc3->forward(x);
-        return x;
-    }
-};
-
-TORCH_MODULE(DQNNet);
-
-class DQN {
-public:
-    DQN(int state_size, int action_size, float learning_rate = 0.001f, float gamma = 0.99f)
-        : state_size_(state_size),
-          action_size_(action_size),
-          gamma_(gamma),
-          device_(torch::kCPU),
-
-          current_lr_(learning_rate) {
-
-        std::cout << "Using CPU for training" << std::endl;
-        torch::set_num_threads(std::thread::hardware_concurrency());
-        std::cout << "Using " << torch::get_num_threads() << " CPU threads" << std::endl;
-
-        policy_net_ = DQNNet(state_size_, action_size_);
-        target_net_ = DQNNet(state_size_, action_size_);
-
-        policy_net_->to(device_);
-        target_net_->to(device_);
-
-        copy_weights(policy_net_, target_net_);
-        target_net_->eval();
-
-        optimizer_ = std::make_unique<torch::optim::Adam>(
-            policy_net_->parameters(),
-            torch::optim::AdamOptions(current_lr_)
-        );
-    }
-
-// Optional: change LR during training
-    void set_learning_rate(float new_lr) {
-        current_lr_ = new_lr;
-        for (auto& group : optimizer_->param_groups()) {
-// AdamOptions is the default group type.
-            static_cast<torch::optim::AdamOptions&>(group.options()).lr(current_lr_);
-        }
-    }
-
-    float get_learning_rate() const { return current_lr_; }
-
-
-// Gradually blend target network with policy network for stability.
-    void soft_update_target(float tau = 0.005f) {
-        torch::NoGradGuard no_grad;
-        auto source_params = policy_net_->named_parameters();
-        auto target_params = target_net_->named_parameters();
-
-        for (auto& param : source_params) {
-            auto& target = target_params[param.key()];
-// θ' ← τθ + (1-τ)θ'.
-            target.copy_(tau * param.value() + (1.0f - tau) * target);
-        }
-    }
-
-    std::vector<float> predict(const std::vector<float>& state) {
-        torch::NoGradGuard no_grad;
-
-        if ((int)state.size() != state_size_) {
-            std::cerr << "DQN::predict state size mismatch. got=" << state.size()
-                      << " expected=" << state_size_ << std::endl;
-        }
-
-        auto state_tensor = torch::from_blob(
-            const_cast<float*>(state.data()),
-            {1, static_cast<long>(state.size())},
-            torch::kFloat
-        ).clone().to(device_);
-
-        auto q_values = policy_net_->forward(state_tensor).to(torch::kCPU);
-
-        std::vector<float> result(action_size_);
-        auto accessor = q_values.accessor<float, 2>();
-        for (int i = 0; i < action_size_; i++) {
-            result[i] = accessor[0][i];
-        }
-        return result;
-    }
-
-// Train on a batch of experiences
-    float train(const std::vector<std::vector<float>>& states,
-                const std::vector<int>& actions,
-                const std::vector<float>& rewards,
-                const std::vector<std::vector<float>>& next_states,
-                const std::vector<bool>& dones,
-                int batch_size) {
-
-// Flatten states
-        std::vector<float> states_flat;
-        states_flat.reserve(batch_size * state_size_);
-        for (const auto& s : states) {
-            states_flat.insert(states_flat.end(), s.begin(), s.end());
-        }
-        auto states_tensor = torch::from_blob(
-            states_flat.data(),
-            {batch_size, state_size_},
-            torch::kFloat
-        ).clone().to(device_);
-
-// Actions
-        std::vector<int64_t> actions_long(actions.begin(), actions.end());
-        auto actions_tensor = torch::from_blob(
-            actions_long.data(),
-            {batch_size, 1},
-            torch::kLong
-        ).clone().to(device_);
-
-// Rewards
-        auto rewards_tensor = torch::from_blob(
-            const_cast<float*>(rewards.data()),
-            {batch_size, 1},
-            torch::kFloat
-        ).clone().to(device_);
-
-// Flatten next states
-        std::vector<float> next_states_flat;
-        next_states_flat.reserve(batch_size * state_size_);
-        for (const auto& s : next_states) {
-            next_states_flat.insert(next_states_flat.end(), s.begin(), s.end());
-        }
-        auto next_states_tensor = torch::from_blob(
-            next_states_flat.data(),
-            {batch_size, state_size_},
-            torch::kFloat
-        ).clone().to(device_);
-
-// Dones
-        std::vector<float> dones_float(dones.begin(), dones.end());
-        auto dones_tensor = torch::from_blob(
-            dones_float.data(),
-            {batch_size, 1},
-            torch::kFloat
-        ).clone().to(device_);
-
-// Current Q(s,a).
-        auto current_q = policy_net_->forward(states_tensor).gather(1, actions_tensor);
-
-// ---- Double DQN target ----
-        torch::Tensor next_q;
-        {
-            torch::NoGradGuard no_grad;
-
-// action selection with policy net.
-            auto next_q_policy = policy_net_->forward(next_states_tensor);
-            auto next_actions = std::get<1>(next_q_policy.max(1, true)); // [B,1] long.
-
-// action evaluation with target net.
-            auto next_q_target = target_net_->forward(next_states_tensor);
-            next_q = next_q_target.gather(1, next_actions); // [B,1].
-        }
-
-        auto target_q = rewards_tensor + (gamma_ * next_q * (1.0f - dones_tensor));
-
-// Huber loss is typically more stable than MSE, but you asked only steps 1–5.
-// Keeping MSE to match your request scope.
-        auto loss = torch::mse_loss(current_q, target_q);
-
-        optimizer_->zero_grad();
-        loss.backward();
-        torch::nn::utils::clip_grad_norm_(policy_net_->parameters(), 1.0);
-        optimizer_->step();
-
-
-        soft_update_target(0.005f);
-
-
-        return loss.item<float>();
-    }
-
-    void update_target_network() { copy_weights(policy_net_, target_net_); }
-
-    void save_model(const std::string& path) {
-        torch::save(policy_net_, path);
-        std::cout << "Model saved to " << path << std::endl;
-    }
-
-    void load_model(const std::string& path) {
-        torch::load(policy_net_, path);
-        copy_weights(policy_net_, target_net_);
-        std::cout << "Model loaded from " << path << std::endl;
-    }
-
-    void set_training_mode(bool training) {
-        if (training) policy_net_->train();
-        else policy_net_->eval();
-    }
-
-private:
-    void copy_weights(DQNNet& source, DQNNet& target) {
-        torch::NoGradGuard no_grad;
-        auto source_params = source->named_parameters();
-        auto target_params = target->named_parameters();
-
-        for (auto& param : source_params) {
-            target_params[param.key()].copy_(param.value());
-        }
-    }
-
-    int state_size_;
-    int action_size_;
-    float gamma_;
-
-    DQNNet policy_net_{nullptr};
-    DQNNet target_net_{nullptr};
-    std::unique_ptr<torch::optim::Adam> optimizer_;
-
-    torch::Device device_;
-
-// int update_counter_;.
-// int target_update_frequency_ = 1000;.
-
-    float current_lr_;
-};
-
+#ifndef DQN_H
+#define DQN_H
+
+#include <torch/torch.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <cstring>
+
+#include "policy_kernel.h"
+#include "native_learner.h"
+#include "replay_buffer.h"
+
+// Simple MLP policy network.
+struct DQNNetImpl : torch::nn::Module {
+    torch::nn::Linear fc1{nullptr}, fc2{nullptr}, fc3{nullptr};
+
+    DQNNetImpl(int64_t state_size, int64_t action_size) {
+        fc1 = register_module("fc1", torch::nn::Linear(state_size, 64));
+        fc2 = register_module("fc2", torch::nn::Linear(64, 64));
+        fc3 = register_module("fc3", torch::nn::Linear(64, action_size));
+    }
+
+    torch::Tensor forward(torch::Tensor x) {
+        x = torch::relu(fc1->forward(x));
+        x = torch::relu(fc2->forward(x));
+        x = fc3->forward(x);
+        return x;
+    }
+};
+
+TORCH_MODULE(DQNNet);
+
+class DQN {
+public:
+    DQN(int state_size, int action_size, float learning_rate = 0.001f, float gamma = 0.99f)
+        : state_size_(state_size),
+          action_size_(action_size),
+          gamma_(gamma),
+          device_(torch::kCPU),
+
+          current_lr_(learning_rate) {
+
+        std::cout << "Using CPU for training" << std::endl;
+        torch::set_num_threads(std::thread::hardware_concurrency());
+        std::cout << "Using " << torch::get_num_threads() << " CPU threads" << std::endl;
+
+        policy_net_ = DQNNet(state_size_, action_size_);
+        target_net_ = DQNNet(state_size_, action_size_);
+
+        policy_net_->to(device_);
+        target_net_->to(device_);
+
+        policy_flat_ = flatten_net(policy_net_);
+        target_flat_ = flatten_net(target_net_);
+        copy_policy_to_target();
+        target_net_->eval();
+
+        optimizer_ = std::make_unique<torch::optim::Adam>(
+            policy_net_->parameters(),
+            torch::optim::AdamOptions(current_lr_)
+        );
+    }
+
+// Optional: change LR during training
+    void set_learning_rate(float new_lr) {
+        current_lr_ = new_lr;
+        for (auto& group : optimizer_->param_groups()) {
+// AdamOptions is the default group type.
+            static_cast<torch::optim::AdamOptions&>(group.options()).lr(current_lr_);
+        }
+        if (native_) native_->set_learning_rate(current_lr_);
+    }
+
+    float get_learning_rate() const { return current_lr_; }
+
+    int state_size() const { return state_size_; }
+    int hidden_size() const { return (int)policy_net_->fc1->weight.size(0); }
+    int action_size() const { return action_size_; }
+    torch::Device device() const { return device_; }
+
+// Train with the NativeLearner (native_learner.h: hand-written forward/backward and Adam over
+// flat buffers) instead of libtorch autograd. The current policy and target weights carry
+// over in both directions; the Adam moments start fresh on every switch. The torch nets are
+// refreshed from the native weights only when something reads them (predict, save_model).
+    void set_native_learner(bool enabled) {
+        if (enabled && !native_) {
+            native_ = std::make_unique<NativeLearner>(state_size_, hidden_size(), action_size_, current_lr_, gamma_);
+            read_flat(policy_flat_, native_->parameters());
+            read_flat(target_flat_, native_->target_parameters());
+        } else if (!enabled && native_) {
+            sync_nets();
+            native_.reset();
+        }
+    }
+
+    bool native_learner() const { return native_ != nullptr; }
+
+// Policy and target weights as flat arrays of parameter_count() floats, in parameters() order.
+// Each net lives in one contiguous buffer, so a snapshot (e.g. for actors or evaluation) is a
+// single copy; target may be null.
+    size_t parameter_count() const { return (size_t)policy_flat_.numel(); }
+
+    void read_parameters(float* policy, float* target = nullptr) {
+        sync_nets();
+        read_flat(policy_flat_, policy);
+        if (target) read_flat(target_flat_, target);
+    }
+
+    void write_parameters(const float* policy, const float* target) {
+        write_flat(policy, policy_flat_);
+        write_flat(target, target_flat_);
+        if (native_) {
+            std::memcpy(native_->parameters(), policy, native_->parameter_count() * sizeof(float));
+            std::memcpy(native_->target_parameters(), target, native_->parameter_count() * sizeof(float));
+        }
+        nets_stale_ = false;
+        kernel_stale_ = true;
+    }
+
+
+// Gradually blend target network with policy network for stability.
+    void soft_update_target(float tau = 0.005f) {
+        if (native_) {
+            native_->soft_update_target(tau);
+            nets_stale_ = true;
+            return;
+        }
+        torch::NoGradGuard no_grad;
+// θ' ← τθ + (1-τ)θ', one pass over the flat buffers.
+        if (device_.is_cpu()) {
+            Axpby((size_t)policy_flat_.numel(), tau, policy_flat_.data_ptr<float>(), 1.0f - tau,
+                  target_flat_.data_ptr<float>());
+        } else {
+            target_flat_.mul_(1.0f - tau).add_(policy_flat_, tau);
+        }
+    }
+
+    std::vector<float> predict(const std::vector<float>& state) {
+        if ((int)state.size() != state_size_) {
+            std::cerr << "DQN::predict state size mismatch. got=" << state.size()
+                      << " expected=" << state_size_ << std::endl;
+        }
+        return predict(state.data());
+    }
+
+// state points at state_size floats (e.g. an Observation or a VecEnv row).
+    std::vector<float> predict(const float* state) {
+        sync_nets();
+        torch::NoGradGuard no_grad;
+
+        auto state_tensor = torch::from_blob(
+            const_cast<float*>(state),
+            {1, static_cast<long>(state_size_)},
+            torch::kFloat
+        ).clone().to(device_);
+
+        auto q_values = policy_net_->forward(state_tensor).to(torch::kCPU);
+
+        std::vector<float> result(action_size_);
+        auto accessor = q_values.accessor<float, 2>();
+        for (int i = 0; i < action_size_; i++) {
+            result[i] = accessor[0][i];
+        }
+        return result;
+    }
+
+// Q-values for n observations: states is n x state_size (row-major), q_out receives
+// n x action_size. Runs on the fused CPU kernel (policy_kernel.h), which is refreshed from the
+// policy net on the first call after a train step or load.
+    void predict_batch(const float* states, int n, float* q_out) {
+        sync_kernel().Forward(states, n, q_out);
+    }
+
+// Greedy action per observation (first maximum on ties, like std::max_element over predict).
+    void predict_actions(const float* states, int n, int* actions_out) {
+        sync_kernel().Act(states, n, actions_out);
+    }
+
+// predict_batch through libtorch in one forward pass (reference for the kernel). On the CPU
+// the input block is wrapped, not copied, and the output is copied out once.
+    void predict_batch_torch(const float* states, int n, float* q_out) {
+        sync_nets();
+        torch::NoGradGuard no_grad;
+        auto q_values = forward_rows(states, n);
+        std::memcpy(q_out, q_values.data_ptr<float>(), (size_t)n * action_size_ * sizeof(float));
+    }
+
+// Train on a batch of experiences
+    float train(const std::vector<std::vector<float>>& states,
+                const std::vector<int>& actions,
+                const std::vector<float>& rewards,
+                const std::vector<std::vector<float>>& next_states,
+                const std::vector<bool>& dones,
+                int batch_size) {
+
+// Flatten states
+        std::vector<float> states_flat;
+        states_flat.reserve(batch_size * state_size_);
+        for (const auto& s : states) {
+            states_flat.insert(states_flat.end(), s.begin(), s.end());
+        }
+
+// Flatten next states
+        std::vector<float> next_states_flat;
+        next_states_flat.reserve(batch_size * state_size_);
+        for (const auto& s : next_states) {
+            next_states_flat.insert(next_states_flat.end(), s.begin(), s.end());
+        }
+
+        std::vector<int64_t> actions_long(actions.begin(), actions.end());
+        std::vector<float> dones_float(dones.begin(), dones.end());
+        return train(states_flat.data(), actions_long.data(), rewards.data(),
+                     next_states_flat.data(), dones_float.data(), batch_size);
+    }
+
+// Train on flat row-major arrays (e.g. a ReplayBatch): states/next_states are
+// batch_size x state_size, dones are 0/1 floats.
+// weights (optional) scale each sample's squared error (prioritized replay importance
+// sampling); td_errors (optional) receives target - Q(s,a) per sample for priority updates.
+    float train(const float* states,
+                const int64_t* actions,
+                const float* rewards,
+                const float* next_states,
+                const float* dones,
+                int batch_size,
+                const float* weights = nullptr,
+                float* td_errors = nullptr) {
+
+        if (native_) {
+            return native_step(native_->train(states, actions, rewards, next_states, dones, batch_size,
+                                              weights, td_errors));
+        }
+
+        auto states_tensor = torch::from_blob(
+            const_cast<float*>(states),
+            {batch_size, state_size_},
+            torch::kFloat
+        ).clone().to(device_);
+
+// Actions
+        auto actions_tensor = torch::from_blob(
+            const_cast<int64_t*>(actions),
+            {batch_size, 1},
+            torch::kLong
+        ).clone().to(device_);
+
+// Rewards
+        auto rewards_tensor = torch::from_blob(
+            const_cast<float*>(rewards),
+            {batch_size, 1},
+            torch::kFloat
+        ).clone().to(device_);
+
+        auto next_states_tensor = torch::from_blob(
+            const_cast<float*>(next_states),
+            {batch_size, state_size_},
+            torch::kFloat
+        ).clone().to(device_);
+
+// Dones
+        auto dones_tensor = torch::from_blob(
+            const_cast<float*>(dones),
+            {batch_size, 1},
+            torch::kFloat
+        ).clone().to(device_);
+
+        torch::Tensor weights_tensor;
+        if (weights) {
+            weights_tensor = torch::from_blob(
+                const_cast<float*>(weights),
+                {batch_size, 1},
+                torch::kFloat
+            ).clone().to(device_);
+        }
+
+// TD errors are written straight into the caller's array.
+        torch::Tensor td_tensor;
+        if (td_errors) td_tensor = torch::from_blob(td_errors, {batch_size, 1}, torch::kFloat);
+
+        return train_step(states_tensor, actions_tensor, rewards_tensor, next_states_tensor,
+                          dones_tensor, weights_tensor, td_tensor);
+    }
+
+// Persistent training batch. The replay sampler fills these tensors in place through
+// view(), and train(TrainBatch&) consumes them as-is: no intermediate vectors, no clones.
+    struct TrainBatch {
+        int size = 0;
+        torch::Tensor states; // [B, state_size].
+        torch::Tensor actions; // [B, 1] int64.
+        torch::Tensor rewards; // [B, 1].
+        torch::Tensor next_states; // [B, state_size].
+        torch::Tensor dones; // [B, 1].
+        torch::Tensor weights; // [B, 1] importance-sampling weights.
+        torch::Tensor steps; // [B, 1] bootstrap horizon k (target uses gamma^k).
+        torch::Tensor td_errors; // [B, 1] target - Q(s,a), written by train.
+        std::vector<int> indices; // replay slots of the rows.
+        int64_t generation = 0; // ReplayBuffer::added() when sampled (for update_priorities).
+
+        void allocate(int batch_size, int state_size, torch::Device device) {
+            auto f = torch::TensorOptions().dtype(torch::kFloat).device(device);
+            size = batch_size;
+            states = torch::zeros({batch_size, state_size}, f);
+            actions = torch::zeros({batch_size, 1}, f.dtype(torch::kLong));
+            rewards = torch::zeros({batch_size, 1}, f);
+            next_states = torch::zeros({batch_size, state_size}, f);
+            dones = torch::zeros({batch_size, 1}, f);
+            weights = torch::ones({batch_size, 1}, f);
+            steps = torch::ones({batch_size, 1}, f);
+            td_errors = torch::zeros({batch_size, 1}, f);
+            indices.assign(batch_size, 0);
+        }
+
+        ReplayBatchView view() {
+            ReplayBatchView v;
+            v.size = size;
+            v.indices = indices.data();
+            v.states = states.data_ptr<float>();
+            v.actions = actions.data_ptr<int64_t>();
+            v.rewards = rewards.data_ptr<float>();
+            v.next_states = next_states.data_ptr<float>();
+            v.dones = dones.data_ptr<float>();
+            v.weights = weights.data_ptr<float>();
+            v.steps = steps.data_ptr<float>();
+            return v;
+        }
+    };
+
+// The learner's batch tensors for batch_size rows, allocated on first use (or size change).
+    TrainBatch& train_batch(int batch_size) {
+        if (batch_.size != batch_size) batch_.allocate(batch_size, state_size_, device_);
+        return batch_;
+    }
+
+// Train on the filled TrainBatch. weighted applies batch.weights; TD errors always land in
+// batch.td_errors.
+    float train(TrainBatch& batch, bool weighted) {
+        if (native_) {
+            return native_step(native_->train(batch.states.data_ptr<float>(), batch.actions.data_ptr<int64_t>(),
+                                              batch.rewards.data_ptr<float>(), batch.next_states.data_ptr<float>(),
+                                              batch.dones.data_ptr<float>(), batch.size,
+                                              weighted ? batch.weights.data_ptr<float>() : nullptr,
+                                              batch.td_errors.data_ptr<float>(), batch.steps.data_ptr<float>()));
+        }
+        return train_step(batch.states, batch.actions, batch.rewards, batch.next_states, batch.dones,
+                          weighted ? batch.weights : torch::Tensor(), batch.td_errors, batch.steps);
+    }
+
+    void update_target_network() {
+        if (native_) {
+            native_->update_target();
+            nets_stale_ = true;
+            return;
+        }
+        copy_policy_to_target();
+    }
+
+    void save_model(const std::string& path) {
+        sync_nets();
+        torch::save(policy_net_, path);
+        std::cout << "Model saved to " << path << std::endl;
+    }
+
+    void load_model(const std::string& path) {
+        torch::load(policy_net_, path);
+// Loading replaces the parameters' storage: gather them into the flat buffer again.
+        policy_flat_ = flatten_net(policy_net_);
+        copy_policy_to_target();
+        if (native_) {
+            read_flat(policy_flat_, native_->parameters());
+            native_->update_target();
+            nets_stale_ = false;
+        }
+        kernel_stale_ = true;
+        std::cout << "Model loaded from " << path << std::endl;
+    }
+
+    void set_training_mode(bool training) {
+        if (training) policy_net_->train();
+        else policy_net_->eval();
+    }
+
+private:
+// The inference kernel with the current policy weights (copied over only when they changed).
+    PolicyKernel& sync_kernel() {
+        if (kernel_stale_ && native_) {
+            native_->load_kernel(kernel_);
+            kernel_stale_ = false;
+        } else if (kernel_stale_) {
+            torch::NoGradGuard no_grad;
+            auto w1 = policy_net_->fc1->weight.to(torch::kCPU).contiguous();
+            auto b1 = policy_net_->fc1->bias.to(torch::kCPU).contiguous();
+            auto w2 = policy_net_->fc2->weight.to(torch::kCPU).contiguous();
+            auto b2 = policy_net_->fc2->bias.to(torch::kCPU).contiguous();
+            auto w3 = policy_net_->fc3->weight.to(torch::kCPU).contiguous();
+            auto b3 = policy_net_->fc3->bias.to(torch::kCPU).contiguous();
+            kernel_.Load(state_size_, (int)w1.size(0), (int)w2.size(0), action_size_,
+                         w1.data_ptr<float>(), b1.data_ptr<float>(), w2.data_ptr<float>(), b2.data_ptr<float>(),
+                         w3.data_ptr<float>(), b3.data_ptr<float>());
+            kernel_stale_ = false;
+        }
+        return kernel_;
+    }
+
+// After a native train step: the kernel and the torch nets are behind the native weights.
+    float native_step(float loss) {
+        kernel_stale_ = true;
+        nets_stale_ = true;
+        return loss;
+    }
+
+// Copies the native weights into the torch nets if they changed since the last copy.
+    void sync_nets() {
+        if (!native_ || !nets_stale_) return;
+        write_flat(native_->parameters(), policy_flat_);
+        write_flat(native_->target_parameters(), target_flat_);
+        nets_stale_ = false;
+    }
+
+// Re-points every parameter of net at a slice of one new contiguous buffer (values kept), in
+// parameters() order, and returns the buffer: the whole net then updates or copies as one array.
+    static torch::Tensor flatten_net(DQNNet& net) {
+        torch::NoGradGuard no_grad;
+        auto params = net->parameters();
+        int64_t count = 0;
+        for (const auto& p : params) count += p.numel();
+        auto flat = torch::empty({count}, params[0].options());
+        int64_t offset = 0;
+        for (auto& p : params) {
+            auto slice = flat.narrow(0, offset, p.numel()).view(p.sizes());
+            slice.copy_(p);
+            p.set_data(slice);
+            offset += p.numel();
+        }
+        return flat;
+    }
+
+    static void read_flat(const torch::Tensor& flat, float* out) {
+        auto cpu = flat.to(torch::kCPU);
+        std::memcpy(out, cpu.data_ptr<float>(), cpu.numel() * sizeof(float));
+    }
+
+    static void write_flat(const float* in, torch::Tensor& flat) {
+        torch::NoGradGuard no_grad;
+        flat.copy_(torch::from_blob(const_cast<float*>(in), {flat.numel()}, torch::kFloat));
+    }
+
+    void copy_policy_to_target() {
+        torch::NoGradGuard no_grad;
+        target_flat_.copy_(policy_flat_);
+    }
+
+// Policy forward over n contiguous rows, result contiguous on the CPU.
+    torch::Tensor forward_rows(const float* states, int n) {
+        auto input = torch::from_blob(const_cast<float*>(states), {n, state_size_}, torch::kFloat);
+        if (!device_.is_cpu()) input = input.to(device_);
+        return policy_net_->forward(input).to(torch::kCPU).contiguous();
+    }
+
+// One Double-DQN update. weights, td_out and steps are optional (undefined tensors); without
+// steps every row bootstraps one step ahead (gamma), with it row i uses gamma^steps_i.
+    float train_step(const torch::Tensor& states_tensor,
+                     const torch::Tensor& actions_tensor,
+                     const torch::Tensor& rewards_tensor,
+                     const torch::Tensor& next_states_tensor,
+                     const torch::Tensor& dones_tensor,
+                     const torch::Tensor& weights_tensor,
+                     torch::Tensor td_out,
+                     const torch::Tensor& steps_tensor = torch::Tensor()) {
+
+// Current Q(s,a).
+        auto current_q = policy_net_->forward(states_tensor).gather(1, actions_tensor);
+
+// ---- Double DQN target ----
+        torch::Tensor next_q;
+        {
+            torch::NoGradGuard no_grad;
+
+// action selection with policy net.
+            auto next_q_policy = policy_net_->forward(next_states_tensor);
+            auto next_actions = std::get<1>(next_q_policy.max(1, true)); // [B,1] long.
+
+// action evaluation with target net.
+            auto next_q_target = target_net_->forward(next_states_tensor);
+            next_q = next_q_target.gather(1, next_actions); // [B,1].
+        }
+
+        torch::Tensor target_q;
+        if (steps_tensor.defined()) {
+            target_q = rewards_tensor + (torch::pow(gamma_, steps_tensor) * next_q * (1.0f - dones_tensor));
+        } else {
+            target_q = rewards_tensor + (gamma_ * next_q * (1.0f - dones_tensor));
+        }
+
+// Huber loss is typically more stable than MSE, but you asked only steps 1–5.
+// Keeping MSE to match your request scope.
+        torch::Tensor loss;
+        if (weights_tensor.defined()) {
+            loss = (weights_tensor * (current_q - target_q).pow(2)).mean();
+        } else {
+            loss = torch::mse_loss(current_q, target_q);
+        }
+
+        if (td_out.defined()) {
+            torch::NoGradGuard no_grad;
+            td_out.copy_(target_q - current_q);
+        }
+
+        optimizer_->zero_grad();
+        loss.backward();
+        torch::nn::utils::clip_grad_norm_(policy_net_->parameters(), 1.0);
+        optimizer_->step();
+        kernel_stale_ = true;
+
+        soft_update_target(0.005f);
+
+
+        return loss.item<float>();
+    }
+
+    int state_size_;
+    int action_size_;
+    float gamma_;
+
+    DQNNet policy_net_{nullptr};
+    DQNNet target_net_{nullptr};
+    torch::Tensor policy_flat_; // every policy_net_ parameter is a view into this buffer.
+    torch::Tensor target_flat_; // same for target_net_.
+    std::unique_ptr<torch::optim::Adam> optimizer_;
+    TrainBatch batch_;
+    PolicyKernel kernel_;
+    bool kernel_stale_ = true; // policy weights changed since the last kernel_.Load.
+    std::unique_ptr<NativeLearner> native_; // set while training natively (owns the weights).
+    bool nets_stale_ = false; // the torch nets are behind native_.
+
+    torch::Device device_;
+
+// int update_counter_;.
+// int target_update_frequency_ = 1000;.
+
+    float current_lr_;
+};
+
 #endif // DQN_H
\ No newline at end of file
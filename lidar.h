@@ -0,0 +1,138 @@
+#ifndef LIDAR_H
+#define LIDAR_H
+
+#include "raylib.h"
+#include "surface_grid.h"
+#include "distance_field.h"
+#include "wall_mask.h"
+#include "occupancy_mip.h"
+#include "lidar_table.h"
+
+#include <cmath>
+#include <string>
+#include <iostream>
+
+// Exact grid traversal (Amanatides & Woo): visits every cell the ray passes through exactly
+// once and returns the ray parameter where it enters the first solid cell, so the distance
+// is sub-pixel accurate and thin wall corners cannot be stepped over.
+// Cells use floor() of the continuous position (the marchers truncate), which only differs
+// for the out-of-bounds strip at negative coordinates.
+template <class Occupancy>
+float CastDDARay(const Occupancy& grid, Vector2 position, float angle, float maxDistance) {
+    const float INF = 1e30f;
+    const float dirX = cosf(angle);
+    const float dirY = sinf(angle);
+
+    int x = (int)floorf(position.x);
+    int y = (int)floorf(position.y);
+    if (grid.SolidAt(x, y)) return 0.0f;
+
+    const int stepX = (dirX > 0.0f) ? 1 : -1;
+    const int stepY = (dirY > 0.0f) ? 1 : -1;
+
+// Ray length to cross one cell on each axis, and to reach the first boundary.
+    const float tDeltaX = (dirX != 0.0f) ? fabsf(1.0f / dirX) : INF;
+    const float tDeltaY = (dirY != 0.0f) ? fabsf(1.0f / dirY) : INF;
+    float tMaxX = (dirX != 0.0f) ? ((dirX > 0.0f) ? (x + 1 - position.x) : (position.x - x)) * tDeltaX : INF;
+    float tMaxY = (dirY != 0.0f) ? ((dirY > 0.0f) ? (y + 1 - position.y) : (position.y - y)) * tDeltaY : INF;
+
+    while (true) {
+        float t;
+        if (tMaxX < tMaxY) {
+            t = tMaxX;
+            tMaxX += tDeltaX;
+            x += stepX;
+        } else {
+            t = tMaxY;
+            tMaxY += tDeltaY;
+            y += stepY;
+        }
+
+        if (t >= maxDistance) return maxDistance;
+        if (grid.SolidAt(x, y)) return t;
+    }
+}
+
+// Ray caster used for the LIDAR part of the observation.
+enum class LidarMode {
+    March, // 2px march over SurfaceGrid (reference semantics).
+    DistanceField, // sphere tracing on the 2px lattice (identical to March).
+    WallMask, // 2px march over the 1-bit mask (identical to March).
+    DDA, // exact cell traversal, sub-pixel distances (not identical to March).
+    Batch, // March semantics; VecEnv casts all cars' rays in one SIMD batch (lidar_simd.h).
+    Mip, // march that skips empty blocks of a min/max pyramid (identical to March).
+    Table // interpolated lookup in a precomputed, memory-mapped table (approximates March).
+};
+
+inline bool ParseLidarMode(const std::string& name, LidarMode& mode) {
+    if (name == "march") { mode = LidarMode::March; return true; }
+    if (name == "field") { mode = LidarMode::DistanceField; return true; }
+    if (name == "mask")  { mode = LidarMode::WallMask; return true; }
+    if (name == "dda")   { mode = LidarMode::DDA; return true; }
+    if (name == "simd")  { mode = LidarMode::Batch; return true; }
+    if (name == "mip")   { mode = LidarMode::Mip; return true; }
+    if (name == "lut")   { mode = LidarMode::Table; return true; }
+    return false;
+}
+
+inline const char* LidarModeName(LidarMode mode) {
+    switch (mode) {
+        case LidarMode::March: return "march";
+        case LidarMode::DistanceField: return "field";
+        case LidarMode::WallMask: return "mask";
+        case LidarMode::DDA: return "dda";
+        case LidarMode::Batch: return "simd";
+        case LidarMode::Mip: return "mip";
+        case LidarMode::Table: return "lut";
+    }
+    return "?";
+}
+
+// Runtime-selectable LIDAR backend over a baked surface grid.
+// Only the structure the selected mode needs is built. Usable wherever GetState takes a track.
+class LidarSensor {
+public:
+    LidarSensor(const SurfaceGrid& grid, LidarMode mode)
+        : width(grid.width), height(grid.height), grid_(grid), mode_(mode) {
+        if (mode_ == LidarMode::DistanceField) field_ = BuildDistanceField(grid);
+        if (mode_ == LidarMode::WallMask) mask_ = BuildWallMask(grid);
+        if (mode_ == LidarMode::Mip) mip_ = BuildOccupancyMip(grid);
+        if (mode_ == LidarMode::Table && !table_.LoadOrBuild(grid, LidarTablePath(grid))) {
+            std::cerr << "LIDAR table unavailable, falling back to march\n";
+            mode_ = LidarMode::March;
+        }
+    }
+
+    LidarMode mode() const { return mode_; }
+    const SurfaceGrid& grid() const { return grid_; }
+
+    float Cast(Vector2 position, float angle, float maxDistance) const {
+        switch (mode_) {
+            case LidarMode::DistanceField: return CastLIDARRay(field_, position, angle, maxDistance);
+            case LidarMode::WallMask: return CastLIDARRay(mask_, position, angle, maxDistance);
+            case LidarMode::DDA: return CastDDARay(grid_, position, angle, maxDistance);
+            case LidarMode::Mip: return CastLIDARRay(mip_, position, angle, maxDistance);
+            case LidarMode::Table: return table_.Cast(position, angle, maxDistance);
+            case LidarMode::March:
+            case LidarMode::Batch: break;
+        }
+        return CastLIDARRay(grid_, position, angle, maxDistance);
+    }
+
+    int width;
+    int height;
+
+private:
+    const SurfaceGrid& grid_;
+    LidarMode mode_;
+    DistanceField field_;
+    WallMask mask_;
+    OccupancyMip mip_;
+    LidarTable table_;
+};
+
+inline float CastLIDARRay(const LidarSensor& sensor, Vector2 position, float angle, float maxDistance) {
+    return sensor.Cast(position, angle, maxDistance);
+}
+
+#endif // LIDAR_H
@@ -0,0 +1,216 @@
+#ifndef LIDAR_SIMD_H
+#define LIDAR_SIMD_H
+
+#include "raylib.h"
+#include "surface_grid.h"
+#include "racing_env.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Batched LIDAR kernel: marches many rays over the surface grid at once.
+// cos/sin are evaluated once per ray (not per sample), and with AVX2 eight rays advance
+// per iteration using gathers and per-lane termination masks. Sample positions are
+// computed exactly like the scalar marcher (double products, rounded to float, truncated),
+// so distances are bit-identical to CastLIDARRay(SurfaceGrid).
+
+// cos(float) is the C double function with libstdc++, but a float overload elsewhere (libc++,
+// MSVC). Directions are stored as double and narrowed back so the arithmetic always matches
+// the scalar marcher; the AVX2 path (double lanes) is only used when the two agree.
+typedef decltype(cos(0.0f)) LidarTrig;
+constexpr bool LIDAR_TRIG_IS_DOUBLE = std::is_same<LidarTrig, double>::value;
+
+// One ray with precomputed direction (same arithmetic as CastLIDARRay(SurfaceGrid)).
+inline float CastLIDARRayDir(const SurfaceGrid& grid, float originX, float originY,
+                             double cosDir, double sinDir, float maxDistance) {
+    float distance = 0.0f;
+    const float step = 2.0f;
+    const LidarTrig cosA = (LidarTrig)cosDir;
+    const LidarTrig sinA = (LidarTrig)sinDir;
+
+    while (distance < maxDistance) {
+        float checkX = originX + cosA * distance;
+        float checkY = originY + sinA * distance;
+
+        if (IsSolid(grid.At((int)checkX, (int)checkY))) return distance;
+
+        distance += step;
+    }
+
+    return maxDistance;
+}
+
+// Casts count rays: origin (ox, oy), direction (cosA, sinA), range maxD -> out distances.
+// The AVX2 path keeps eight rays in flight; when a lane's ray hits a wall or runs out of
+// range its result is written and the next pending ray is loaded into that lane, so short
+// and long rays can share a batch without idle lanes.
+inline void CastLIDARRays(const SurfaceGrid& grid,
+                          const float* ox, const float* oy,
+                          const double* cosA, const double* sinA,
+                          const float* maxD, float* out, int count) {
+#ifdef __AVX2__
+    if (LIDAR_TRIG_IS_DOUBLE && count >= 8) {
+// Gathers read 4 bytes per lane; SurfaceGrid keeps GATHER_SLACK bytes after the last cell.
+        const int* base = (const int*)(grid.cells.data() + (size_t)SurfaceGrid::PAD * grid.stride + SurfaceGrid::PAD);
+        const __m256i stride = _mm256_set1_epi32(grid.stride);
+        const __m256i byteMask = _mm256_set1_epi32(0xFF);
+        const __m256i wallClass = _mm256_set1_epi32(SURFACE_WALL - 1);
+        const __m256 step = _mm256_set1_ps(2.0f);
+
+// Lane state lives in these arrays and is reloaded into registers after a refill.
+        alignas(32) double laneX[8], laneY[8], laneCos[8], laneSin[8];
+        alignas(32) float laneDist[8], laneMax[8];
+        alignas(32) int laneLive[8];
+        int laneRay[8];
+
+        int next = 0;
+        for (int l = 0; l < 8; l++, next++) {
+            laneX[l] = ox[next]; laneY[l] = oy[next];
+            laneCos[l] = cosA[next]; laneSin[l] = sinA[next];
+            laneDist[l] = 0.0f; laneMax[l] = maxD[next];
+            laneLive[l] = -1; laneRay[l] = next;
+        }
+
+        while (true) {
+            const __m256d ox0 = _mm256_load_pd(laneX), ox1 = _mm256_load_pd(laneX + 4);
+            const __m256d oy0 = _mm256_load_pd(laneY), oy1 = _mm256_load_pd(laneY + 4);
+            const __m256d c0 = _mm256_load_pd(laneCos), c1 = _mm256_load_pd(laneCos + 4);
+            const __m256d s0 = _mm256_load_pd(laneSin), s1 = _mm256_load_pd(laneSin + 4);
+            const __m256 maxd = _mm256_load_ps(laneMax);
+            const __m256 live = _mm256_castsi256_ps(_mm256_load_si256((const __m256i*)laneLive));
+            __m256 dist = _mm256_load_ps(laneDist);
+            __m256 sampled, hit;
+            int finished = 0;
+
+// March all lanes until at least one finishes (every live lane has dist < maxD here).
+            do {
+                __m256d d0 = _mm256_cvtps_pd(_mm256_castps256_ps128(dist));
+                __m256d d1 = _mm256_cvtps_pd(_mm256_extractf128_ps(dist, 1));
+
+                __m128 x0 = _mm256_cvtpd_ps(_mm256_add_pd(ox0, _mm256_mul_pd(c0, d0)));
+                __m128 x1 = _mm256_cvtpd_ps(_mm256_add_pd(ox1, _mm256_mul_pd(c1, d1)));
+                __m128 y0 = _mm256_cvtpd_ps(_mm256_add_pd(oy0, _mm256_mul_pd(s0, d0)));
+                __m128 y1 = _mm256_cvtpd_ps(_mm256_add_pd(oy1, _mm256_mul_pd(s1, d1)));
+
+                __m256i ix = _mm256_cvttps_epi32(_mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1));
+                __m256i iy = _mm256_cvttps_epi32(_mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1));
+                __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(iy, stride), ix);
+
+                __m256i cls = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, idx,
+                                                           _mm256_castps_si256(live), 1);
+                cls = _mm256_and_si256(cls, byteMask);
+
+                hit = _mm256_and_ps(live, _mm256_castsi256_ps(_mm256_cmpgt_epi32(cls, wallClass)));
+// dist advances unconditionally so the next addresses do not wait on this gather.
+                sampled = dist;
+                dist = _mm256_add_ps(dist, step);
+                __m256 expired = _mm256_and_ps(live, _mm256_cmp_ps(dist, maxd, _CMP_GE_OQ));
+                finished = _mm256_movemask_ps(_mm256_or_ps(hit, expired));
+            } while (finished == 0);
+
+            _mm256_store_ps(laneDist, _mm256_blendv_ps(dist, sampled, hit));
+            const int hitBits = _mm256_movemask_ps(hit);
+
+            for (int l = 0; l < 8; l++) {
+                if (!(finished & (1 << l))) continue;
+                out[laneRay[l]] = (hitBits & (1 << l)) ? laneDist[l] : laneMax[l];
+
+                if (next < count) {
+                    laneX[l] = ox[next]; laneY[l] = oy[next];
+                    laneCos[l] = cosA[next]; laneSin[l] = sinA[next];
+                    laneDist[l] = 0.0f; laneMax[l] = maxD[next];
+                    laneRay[l] = next++;
+                } else {
+// Drained lane: masked out of gathers and never reported as finished again.
+                    laneLive[l] = 0;
+                }
+            }
+
+            int anyLive = 0;
+            for (int l = 0; l < 8; l++) anyLive |= laneLive[l];
+            if (!anyLive) break;
+        }
+        return;
+    }
+#endif
+
+    for (int i = 0; i < count; i++) {
+        out[i] = CastLIDARRayDir(grid, ox[i], oy[i], cosA[i], sinA[i], maxD[i]);
+    }
+}
+
+// Fills full 23-float observations for many cars at once: the 5 base features plus the
+// 18 LIDAR features from one batched cast (rays from all cars share SIMD lanes).
+// Values match GetState(SurfaceGrid) exactly. Scratch buffers are reused across calls.
+class LidarBatch {
+public:
+    static constexpr int RAYS_PER_CAR = LIDAR_SHORT_COUNT + LIDAR_LONG_COUNT;
+    static constexpr int STATE_SIZE = OBSERVATION_SIZE;
+
+    void ComputeStates(const SurfaceGrid& grid,
+                       const float* posX, const float* posY,
+                       const float* angle, const float* speed,
+                       int numCars, float* states) {
+        const int count = numCars * RAYS_PER_CAR;
+        Reserve(count);
+
+        for (int c = 0; c < numCars; c++) {
+            int r = c * RAYS_PER_CAR;
+            for (float offset : LIDAR_SHORT_OFFSETS) AddRay(r++, posX[c], posY[c], angle[c] + offset, LIDAR_RANGE);
+            for (float offset : LIDAR_LONG_OFFSETS)  AddRay(r++, posX[c], posY[c], angle[c] + offset, LONG_RANGE);
+        }
+
+        CastLIDARRays(grid, ox_.data(), oy_.data(), cos_.data(), sin_.data(), maxD_.data(), dist_.data(), count);
+
+        const float MAX_SPEED = 300.0f;
+        for (int c = 0; c < numCars; c++) {
+            float* state = states + (size_t)c * STATE_SIZE;
+            const float* d = &dist_[(size_t)c * RAYS_PER_CAR];
+
+            state[STATE_SPEED] = speed[c] / MAX_SPEED;
+            state[STATE_HEADING_SIN] = sin(angle[c]);
+            state[STATE_HEADING_COS] = cos(angle[c]);
+            state[STATE_POS_X] = posX[c] / (float)grid.width;
+            state[STATE_POS_Y] = posY[c] / (float)grid.height;
+
+            for (int k = 0; k < LIDAR_SHORT_COUNT; k++) {
+                float danger = 1.0f / ((d[k] / REFERENCE_DIST) + 0.1f);
+                state[STATE_SHORT_LIDAR + k] = std::min(1.0f, danger);
+            }
+            for (int k = 0; k < LIDAR_LONG_COUNT; k++) {
+                float norm = d[LIDAR_SHORT_COUNT + k] / LONG_RANGE;
+                if (norm < 0.0f) norm = 0.0f;
+                if (norm > 1.0f) norm = 1.0f;
+                state[STATE_LONG_LIDAR + k] = norm;
+            }
+        }
+    }
+
+private:
+    void Reserve(int count) {
+        if ((int)ox_.size() >= count) return;
+        ox_.resize(count); oy_.resize(count);
+        cos_.resize(count); sin_.resize(count);
+        maxD_.resize(count); dist_.resize(count);
+    }
+
+    void AddRay(int r, float x, float y, float rayAngle, float range) {
+        ox_[r] = x;
+        oy_[r] = y;
+        cos_[r] = cos(rayAngle);
+        sin_[r] = sin(rayAngle);
+        maxD_[r] = range;
+    }
+
+    std::vector<float> ox_, oy_;
+    std::vector<double> cos_, sin_;
+    std::vector<float> maxD_, dist_;
+};
+
+#endif // LIDAR_SIMD_H
@@ -0,0 +1,216 @@
+#ifndef LIDAR_TABLE_H
+#define LIDAR_TABLE_H
+
+#include "raylib.h"
+#include "surface_grid.h"
+#include "racing_env.h"
+#include "lidar_simd.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+// Precomputed LIDAR: hit distance for every node of a CELL px grid and every one of BINS
+// absolute ray directions, interpolated trilinearly at runtime. Ray results only depend on
+// position and absolute direction, and a short ray is exactly min(long ray, its range), so one
+// table with LONG_RANGE distances serves all 18 rays without any casting.
+// Distances are uint16 in 1/SCALE px. The table lives in a memory-mapped cache file keyed by a
+// hash of the baked track, so later runs map it instead of rebuilding.
+struct LidarTableHeader {
+    char magic[8]; // "LIDARLUT", written last so an interrupted build is never loaded.
+    uint32_t version;
+    uint32_t cell;
+    uint32_t bins;
+    uint32_t nodesX;
+    uint32_t nodesY;
+    uint32_t scale;
+    float range;
+    uint32_t reserved;
+    uint64_t trackHash;
+};
+
+// FNV-1a over the baked surface classes (what the rays actually see).
+inline uint64_t HashSurfaceGrid(const SurfaceGrid& grid) {
+    uint64_t h = 1469598103934665603ull;
+    auto mix = [&h](const uint8_t* p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+    };
+    mix((const uint8_t*)&grid.width, sizeof(grid.width));
+    mix((const uint8_t*)&grid.height, sizeof(grid.height));
+    mix(grid.cells.data(), grid.cells.size());
+    return h;
+}
+
+class LidarTable {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int CELL = 2;
+    static constexpr int BINS = 256; // power of two (heading wrap is a mask).
+    static constexpr int SCALE = 64;
+    static constexpr float RANGE = LONG_RANGE;
+
+    int width = 0;
+    int height = 0;
+
+// Maps `path` if it holds a table for this track, otherwise builds it there.
+    bool LoadOrBuild(const SurfaceGrid& grid, const std::string& path) {
+        width = grid.width;
+        height = grid.height;
+        const uint64_t hash = HashSurfaceGrid(grid);
+
+        if (file_.OpenRead(path) && Attach(hash)) {
+            std::cout << "LIDAR table: mapped " << path << " (" << file_.size() / (1024 * 1024) << " MB)\n";
+            return true;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (!Build(grid, hash, path)) {
+            std::cerr << "LIDAR table: could not write " << path << "\n";
+            return false;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "LIDAR table: built " << path << " in " << seconds << " s ("
+                  << file_.size() / (1024 * 1024) << " MB)\n";
+        return true;
+    }
+
+    bool isLoaded() const { return data_ != nullptr; }
+    size_t Bytes() const { return file_.size(); }
+
+// Interpolated hit distance along absolute direction `angle`, capped at maxDistance.
+    float Cast(Vector2 position, float angle, float maxDistance) const {
+        float fx = position.x / CELL;
+        float fy = position.y / CELL;
+        int x0 = std::min(std::max((int)floorf(fx), 0), nodesX_ - 2);
+        int y0 = std::min(std::max((int)floorf(fy), 0), nodesY_ - 2);
+        float tx = std::min(std::max(fx - x0, 0.0f), 1.0f);
+        float ty = std::min(std::max(fy - y0, 0.0f), 1.0f);
+
+        float h = angle * (BINS / (2.0f * PI));
+        h -= floorf(h / BINS) * BINS;
+        int b0 = (int)h;
+        float tb = h - b0;
+        b0 &= BINS - 1;
+        int b1 = (b0 + 1) & (BINS - 1);
+
+        const uint16_t* n00 = Node(x0, y0);
+        const uint16_t* n10 = n00 + BINS;
+        const uint16_t* n01 = n00 + (size_t)nodesX_ * BINS;
+        const uint16_t* n11 = n01 + BINS;
+
+        auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+        float d0 = lerp(lerp(n00[b0], n10[b0], tx), lerp(n01[b0], n11[b0], tx), ty);
+        float d1 = lerp(lerp(n00[b1], n10[b1], tx), lerp(n01[b1], n11[b1], tx), ty);
+        float d = lerp(d0, d1, tb) * (1.0f / SCALE);
+        return std::min(d, maxDistance);
+    }
+
+private:
+    const uint16_t* Node(int x, int y) const { return data_ + ((size_t)y * nodesX_ + x) * BINS; }
+
+    static int NodesFor(int pixels) { return pixels / CELL + 2; }
+
+// Validates the mapped header against this track and the compiled-in layout.
+    bool Attach(uint64_t hash) {
+        if (file_.size() < sizeof(LidarTableHeader)) return false;
+        LidarTableHeader header;
+        std::memcpy(&header, file_.data(), sizeof(header));
+
+        const int nx = NodesFor(width);
+        const int ny = NodesFor(height);
+        const size_t expected = sizeof(LidarTableHeader) + (size_t)nx * ny * BINS * sizeof(uint16_t);
+        if (std::memcmp(header.magic, "LIDARLUT", 8) != 0 || header.version != VERSION ||
+            header.cell != (uint32_t)CELL || header.bins != (uint32_t)BINS || header.scale != (uint32_t)SCALE ||
+            header.range != RANGE || header.nodesX != (uint32_t)nx || header.nodesY != (uint32_t)ny ||
+            header.trackHash != hash || file_.size() != expected) {
+            file_.Close();
+            return false;
+        }
+
+        nodesX_ = nx;
+        nodesY_ = ny;
+        data_ = (const uint16_t*)((const char*)file_.data() + sizeof(LidarTableHeader));
+        return true;
+    }
+
+    bool Build(const SurfaceGrid& grid, uint64_t hash, const std::string& path) {
+        const int nx = NodesFor(width);
+        const int ny = NodesFor(height);
+        const size_t bytes = sizeof(LidarTableHeader) + (size_t)nx * ny * BINS * sizeof(uint16_t);
+        if (!file_.Create(path, bytes)) return false;
+
+        uint16_t* out = (uint16_t*)((char*)file_.data() + sizeof(LidarTableHeader));
+
+// One node row per batch: nx * BINS rays through the batched caster.
+        const int count = nx * BINS;
+        std::vector<float> ox(count), oy(count), maxD(count, RANGE), dist(count);
+        std::vector<double> cosA(count), sinA(count);
+        for (int x = 0; x < nx; x++) {
+            for (int b = 0; b < BINS; b++) {
+                float angle = b * (2.0f * PI / BINS);
+                cosA[(size_t)x * BINS + b] = cos(angle);
+                sinA[(size_t)x * BINS + b] = sin(angle);
+            }
+        }
+
+        for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+                for (int b = 0; b < BINS; b++) {
+                    ox[(size_t)x * BINS + b] = (float)(x * CELL);
+                    oy[(size_t)x * BINS + b] = (float)(y * CELL);
+                }
+            }
+            CastLIDARRays(grid, ox.data(), oy.data(), cosA.data(), sinA.data(), maxD.data(), dist.data(), count);
+            for (int i = 0; i < count; i++) {
+                out[(size_t)y * count + i] = (uint16_t)lroundf(dist[i] * SCALE);
+            }
+        }
+
+        LidarTableHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.version = VERSION;
+        header.cell = CELL;
+        header.bins = BINS;
+        header.nodesX = nx;
+        header.nodesY = ny;
+        header.scale = SCALE;
+        header.range = RANGE;
+        header.trackHash = hash;
+        std::memcpy(header.magic, "LIDARLUT", 8);
+        std::memcpy(file_.data(), &header, sizeof(header));
+        file_.Sync();
+
+        nodesX_ = nx;
+        nodesY_ = ny;
+        data_ = out;
+        return true;
+    }
+
+    MappedFile file_;
+    const uint16_t* data_ = nullptr;
+    int nodesX_ = 0;
+    int nodesY_ = 0;
+};
+
+// Cache file name for a track: lidar_<hash>.lut.
+inline std::string LidarTablePath(const SurfaceGrid& grid, const std::string& dir = ".") {
+    char name[64];
+    std::snprintf(name, sizeof(name), "lidar_%016llx.lut", (unsigned long long)HashSurfaceGrid(grid));
+    return dir + "/" + name;
+}
+
+inline float CastLIDARRay(const LidarTable& table, Vector2 position, float angle, float maxDistance) {
+    return table.Cast(position, angle, maxDistance);
+}
+
+#endif // LIDAR_TABLE_H
@@ -0,0 +1,163 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+// Keep windows.h from clashing with raylib (Rectangle, CloseWindow, DrawText, ...). Each
+// switch is set only if the includer has not set it, and only the ones set here are undone
+// afterwards, so translation units that configure windows.h themselves keep their settings.
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#define MAPPED_FILE_DEFINED_WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#define MAPPED_FILE_DEFINED_NOMINMAX
+#endif
+#ifndef NOGDI
+#define NOGDI
+#define MAPPED_FILE_DEFINED_NOGDI
+#endif
+#ifndef NOUSER
+#define NOUSER
+#define MAPPED_FILE_DEFINED_NOUSER
+#endif
+#include <windows.h>
+#undef near
+#undef far
+#ifdef MAPPED_FILE_DEFINED_WIN32_LEAN_AND_MEAN
+#undef WIN32_LEAN_AND_MEAN
+#undef MAPPED_FILE_DEFINED_WIN32_LEAN_AND_MEAN
+#endif
+#ifdef MAPPED_FILE_DEFINED_NOMINMAX
+#undef NOMINMAX
+#undef MAPPED_FILE_DEFINED_NOMINMAX
+#endif
+#ifdef MAPPED_FILE_DEFINED_NOGDI
+#undef NOGDI
+#undef MAPPED_FILE_DEFINED_NOGDI
+#endif
+#ifdef MAPPED_FILE_DEFINED_NOUSER
+#undef NOUSER
+#undef MAPPED_FILE_DEFINED_NOUSER
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Whole-file memory mapping (POSIX mmap / Win32 file mapping).
+// OpenRead maps an existing file read-only, OpenReadWrite maps an existing file read-write;
+// Create makes (or truncates) a file of the given size and maps it read-write. Writes to a
+// writable mapping reach the file even if the process dies; Sync also forces them to disk.
+// The mapping is released on Close or destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool OpenRead(const std::string& path) { return Open(path, 0, Mode::Read); }
+    bool OpenReadWrite(const std::string& path) { return Open(path, 0, Mode::ReadWrite); }
+    bool Create(const std::string& path, size_t size) { return Open(path, size, Mode::Create); }
+
+    bool isOpen() const { return data_ != nullptr; }
+    void* data() const { return data_; }
+    size_t size() const { return size_; }
+
+// Flushes dirty pages of a writable mapping to disk.
+    bool Sync() {
+        if (!data_ || !writable_) return false;
+#ifdef _WIN32
+        return FlushViewOfFile(data_, 0) != 0 && FlushFileBuffers(file_) != 0;
+#else
+        return msync(data_, size_, MS_SYNC) == 0;
+#endif
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap(data_, size_);
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        writable_ = false;
+    }
+
+private:
+    enum class Mode { Read, ReadWrite, Create };
+
+    bool Open(const std::string& path, size_t size, Mode mode) {
+        Close();
+        const bool create = (mode == Mode::Create);
+        writable_ = (mode != Mode::Read);
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), writable_ ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+                            FILE_SHARE_READ, nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+
+        if (create) {
+            LARGE_INTEGER end;
+            end.QuadPart = (LONGLONG)size;
+            if (!SetFilePointerEx(file_, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file_)) { Close(); return false; }
+        } else {
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file_, &fileSize)) { Close(); return false; }
+            size = (size_t)fileSize.QuadPart;
+        }
+        if (size == 0) { Close(); return false; }
+
+        mapping_ = CreateFileMappingA(file_, nullptr, writable_ ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) { Close(); return false; }
+        data_ = MapViewOfFile(mapping_, writable_ ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+        if (!data_) { Close(); return false; }
+#else
+        if (create) fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        else fd_ = open(path.c_str(), writable_ ? O_RDWR : O_RDONLY);
+        if (fd_ < 0) return false;
+
+        if (create) {
+            if (ftruncate(fd_, (off_t)size) != 0) { Close(); return false; }
+        } else {
+            struct stat st;
+            if (fstat(fd_, &st) != 0) { Close(); return false; }
+            size = (size_t)st.st_size;
+        }
+        if (size == 0) { Close(); return false; }
+
+        void* p = mmap(nullptr, size, writable_ ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) { Close(); return false; }
+        data_ = p;
+#endif
+        size_ = size;
+        return true;
+    }
+
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    bool writable_ = false;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+#endif // MAPPED_FILE_H
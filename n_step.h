@@ -0,0 +1,87 @@
+#ifndef N_STEP_H
+#define N_STEP_H
+
+#include <vector>
+#include <cstring>
+
+// Builds n-step transitions between the env and the replay buffer.
+// Each stream (car) keeps a rolling window of its last n (state, action, reward). Once the
+// window is full, every step emits the oldest entry as
+//   state_t, action_t, R = r_t + gamma r_t+1 + ... + gamma^(n-1) r_t+n-1, next_state = s_t+n,
+// with bootstrap horizon n (the learner discounts next_state by gamma^n). When an episode ends
+// the rest of the window is flushed with shorter horizons, all bootstrapping from the last
+// next_state: a terminal step (done) stores done for each of them, a stuck-break reset (over
+// without done) keeps bootstrapping, since the episode was cut, not finished.
+//
+// Streams are independent and created on first use, so any env layout works as long as each
+// car pushes its own steps in order under a stable stream id.
+class NStepBuilder {
+public:
+    NStepBuilder(int n, float gamma, int state_size) : n_(n), gamma_(gamma), state_size_(state_size) {}
+
+    int n() const { return n_; }
+
+    // One env step of stream. emit(state, action, reward, next_state, done, stream, steps) is
+    // called for every transition that became complete (none, one, or the whole window).
+    template <class Emit>
+    void Push(int stream, const float* state, int action, float reward, const float* next_state,
+              bool done, bool episode_over, Emit&& emit) {
+        if (stream >= (int)windows_.size()) windows_.resize(stream + 1);
+        Window& w = windows_[stream];
+        if (w.states.empty()) {
+            w.states.resize((size_t)n_ * state_size_);
+            w.actions.resize(n_);
+            w.rewards.resize(n_);
+        }
+
+        const int tail = (w.head + w.count) % n_;
+        std::memcpy(&w.states[(size_t)tail * state_size_], state, state_size_ * sizeof(float));
+        w.actions[tail] = action;
+        w.rewards[tail] = reward;
+        w.count++;
+
+        if (episode_over) {
+            while (w.count > 0) EmitOldest(w, next_state, done, stream, emit);
+            w.head = 0;
+        } else if (w.count == n_) {
+            EmitOldest(w, next_state, false, stream, emit);
+        }
+    }
+
+    // Drops every partial window (e.g. before restarting all envs).
+    void Clear() {
+        for (Window& w : windows_) {
+            w.head = 0;
+            w.count = 0;
+        }
+    }
+
+private:
+    struct Window {
+        std::vector<float> states; // n rows, ring.
+        std::vector<int> actions;
+        std::vector<float> rewards;
+        int head = 0; // oldest entry.
+        int count = 0;
+    };
+
+    template <class Emit>
+    void EmitOldest(Window& w, const float* next_state, bool done, int stream, Emit& emit) {
+        float ret = 0.0f;
+        float discount = 1.0f;
+        for (int k = 0; k < w.count; k++) {
+            ret += discount * w.rewards[(w.head + k) % n_];
+            discount *= gamma_;
+        }
+        emit(&w.states[(size_t)w.head * state_size_], w.actions[w.head], ret, next_state, done, stream, w.count);
+        w.head = (w.head + 1) % n_;
+        w.count--;
+    }
+
+    int n_;
+    float gamma_;
+    int state_size_;
+    std::vector<Window> windows_;
+};
+
+#endif // N_STEP_H
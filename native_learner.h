@@ -0,0 +1,264 @@
+#ifndef NATIVE_LEARNER_H
+#define NATIVE_LEARNER_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "policy_kernel.h"
+
+// Double-DQN learner for the policy MLP (in -> hidden -> hidden -> out, ReLU between) without
+// libtorch: forward, MSE loss, hand-written backprop, global-norm gradient clipping, Adam and
+// the soft target update, all over flat contiguous buffers. Computes the same update as
+// DQN::train_step with torch's Adam defaults (betas 0.9 / 0.999, eps 1e-8) and
+// clip_grad_norm_(1.0); results differ only by float summation order.
+//
+// Parameters are laid out like the torch module's parameters(), back to back:
+// fc1.weight [hidden, in], fc1.bias, fc2.weight [hidden, hidden], fc2.bias,
+// fc3.weight [out, hidden], fc3.bias. parameter(t) points at the t-th of these tensors.
+//
+// Forward passes run on PolicyKernel copies of the policy and target nets (packed once per
+// step), keeping the hidden activations; backward is a sequence of Axpy calls over rows of the
+// weights as stored, skipping units whose ReLU is off.
+class NativeLearner {
+public:
+    static const int TENSORS = 6;
+
+    NativeLearner(int state_size, int hidden_size, int action_size, float learning_rate = 0.001f,
+                  float gamma = 0.99f)
+        : in_(state_size), hidden_(hidden_size), out_(action_size), lr_(learning_rate), gamma_(gamma) {
+        sizes_[W1] = (size_t)hidden_ * in_;
+        sizes_[B1] = hidden_;
+        sizes_[W2] = (size_t)hidden_ * hidden_;
+        sizes_[B2] = hidden_;
+        sizes_[W3] = (size_t)out_ * hidden_;
+        sizes_[B3] = out_;
+        count_ = 0;
+        for (int t = 0; t < TENSORS; t++) {
+            offsets_[t] = count_;
+            count_ += sizes_[t];
+        }
+        params_.assign(count_, 0.0f);
+        target_.assign(count_, 0.0f);
+        grads_.assign(count_, 0.0f);
+        m_.assign(count_, 0.0f);
+        v_.assign(count_, 0.0f);
+    }
+
+    int state_size() const { return in_; }
+    int hidden_size() const { return hidden_; }
+    int action_size() const { return out_; }
+    size_t parameter_count() const { return count_; }
+    size_t parameter_size(int tensor) const { return sizes_[tensor]; }
+    float* parameter(int tensor) { return &params_[offsets_[tensor]]; }
+    const float* parameter(int tensor) const { return &params_[offsets_[tensor]]; }
+    float* parameters() { return params_.data(); }
+    const float* parameters() const { return params_.data(); }
+    float* target_parameters() { return target_.data(); }
+    const float* target_parameters() const { return target_.data(); }
+    long long steps() const { return step_; }
+
+    void set_learning_rate(float lr) { lr_ = lr; }
+
+    // Packs the current policy weights into an inference kernel.
+    void load_kernel(PolicyKernel& kernel) const { LoadKernel(kernel, params_.data()); }
+
+    // Hard target update (target <- policy).
+    void update_target() { target_ = params_; }
+
+    // θ' ← τθ + (1-τ)θ'.
+    void soft_update_target(float tau = 0.005f) { Axpby(count_, tau, params_.data(), 1.0f - tau, target_.data()); }
+
+    // Q-values for n rows of the policy (or target) net, n x action_size into q_out.
+    void predict_batch(const float* states, int n, float* q_out, bool target = false) {
+        PolicyKernel& kernel = target ? target_kernel_ : policy_kernel_;
+        LoadKernel(kernel, target ? target_.data() : params_.data());
+        kernel.Forward(states, n, q_out);
+    }
+
+    // One update on a batch, same arguments as DQN::train: states / next_states are
+    // batch_size x state_size, dones 0/1. weights (optional) scale each squared error,
+    // td_errors (optional) receives target - Q(s,a), steps (optional) is each row's bootstrap
+    // horizon k (target uses gamma^k). Returns the loss.
+    float train(const float* states, const int64_t* actions, const float* rewards,
+                const float* next_states, const float* dones, int batch_size,
+                const float* weights = nullptr, float* td_errors = nullptr, const float* steps = nullptr) {
+        const int B = batch_size;
+        if (B != batch_) Allocate(B);
+
+// Double DQN target: policy net picks the next action, target net evaluates it.
+        LoadKernel(policy_kernel_, params_.data());
+        LoadKernel(target_kernel_, target_.data());
+        policy_kernel_.Act(next_states, B, next_actions_.data());
+        target_kernel_.Forward(next_states, B, q_.data());
+        for (int i = 0; i < B; i++) {
+            const float nextQ = q_[(size_t)i * out_ + next_actions_[i]];
+            const float discount = steps ? std::pow(gamma_, steps[i]) : gamma_;
+            targets_[i] = rewards[i] + discount * nextQ * (1.0f - dones[i]);
+        }
+
+// Q(s, a) with the activations kept for backprop.
+        policy_kernel_.Forward(states, B, q_.data(), a1_.data(), a2_.data());
+
+        float loss = 0.0f;
+        for (int i = 0; i < B; i++) {
+            const float diff = q_[(size_t)i * out_ + actions[i]] - targets_[i];
+            const float w = weights ? weights[i] : 1.0f;
+            loss += w * diff * diff;
+            if (td_errors) td_errors[i] = -diff;
+            dq_[i] = 2.0f * w * diff / (float)B;
+        }
+        loss /= (float)B;
+
+        Backward(states, actions, B);
+        ClipGradients(1.0f);
+        Adam();
+        soft_update_target(0.005f);
+        return loss;
+    }
+
+private:
+    static const int W1 = 0, B1 = 1, W2 = 2, B2 = 3, W3 = 4, B3 = 5;
+
+    void Allocate(int B) {
+        batch_ = B;
+        stride_ = (hidden_ + 7) & ~7;
+        a1_.resize((size_t)B * stride_);
+        a2_.resize((size_t)B * stride_);
+        q_.resize((size_t)B * out_);
+        d1_.resize(hidden_);
+        d2_.resize(hidden_);
+        dq_.resize(B);
+        targets_.resize(B);
+        next_actions_.resize(B);
+    }
+
+    void LoadKernel(PolicyKernel& kernel, const float* params) const {
+        kernel.LoadFlat(in_, hidden_, out_, params);
+    }
+
+// Gradients of the loss into grads_. Only Q(s_i, a_i) carries gradient (dq_[i]), so the
+// output layer touches one weight row per sample; ReLU passes gradient where the activation
+// is positive.
+    void Backward(const float* states, const int64_t* actions, int B) {
+        std::fill(grads_.begin(), grads_.end(), 0.0f);
+        const float* w2 = &params_[offsets_[W2]];
+        const float* w3 = &params_[offsets_[W3]];
+        float* gw1 = &grads_[offsets_[W1]];
+        float* gb1 = &grads_[offsets_[B1]];
+        float* gw2 = &grads_[offsets_[W2]];
+        float* gb2 = &grads_[offsets_[B2]];
+        float* gw3 = &grads_[offsets_[W3]];
+        float* gb3 = &grads_[offsets_[B3]];
+
+        for (int i = 0; i < B; i++) {
+            const float g = dq_[i];
+            const int a = (int)actions[i];
+            const float* x = states + (size_t)i * in_;
+            const float* a1 = &a1_[(size_t)i * stride_];
+            const float* a2 = &a2_[(size_t)i * stride_];
+
+            const float* w3Row = w3 + (size_t)a * hidden_;
+            Axpy(hidden_, g, a2, gw3 + (size_t)a * hidden_);
+            gb3[a] += g;
+
+            for (int j = 0; j < hidden_; j++) d2_[j] = (a2[j] > 0.0f) ? g * w3Row[j] : 0.0f;
+
+            std::fill(d1_.begin(), d1_.end(), 0.0f);
+            for (int j = 0; j < hidden_; j++) {
+                const float d = d2_[j];
+                if (d == 0.0f) continue;
+                Axpy(hidden_, d, a1, gw2 + (size_t)j * hidden_);
+                Axpy(hidden_, d, w2 + (size_t)j * hidden_, d1_.data());
+                gb2[j] += d;
+            }
+
+            for (int j = 0; j < hidden_; j++) {
+                if (a1[j] <= 0.0f) continue;
+                Axpy(in_, d1_[j], x, gw1 + (size_t)j * in_);
+                gb1[j] += d1_[j];
+            }
+        }
+    }
+
+// clip_grad_norm_: scale all gradients by max_norm / (norm + 1e-6) when that is below 1.
+    void ClipGradients(float max_norm) {
+        double sum = 0.0;
+        for (size_t p = 0; p < count_; p++) sum += (double)grads_[p] * grads_[p];
+        const float norm = (float)std::sqrt(sum);
+        const float coef = max_norm / (norm + 1e-6f);
+        if (coef < 1.0f) {
+            for (size_t p = 0; p < count_; p++) grads_[p] *= coef;
+        }
+    }
+
+    void Adam() {
+// Coefficients in double, then rounded once, like torch's double-valued options.
+        const double BETA1 = 0.9;
+        const double BETA2 = 0.999;
+        const float EPS = 1e-8f;
+        step_++;
+        const float beta1 = (float)BETA1, keep1 = (float)(1.0 - BETA1);
+        const float beta2 = (float)BETA2, keep2 = (float)(1.0 - BETA2);
+        const float correction2Sqrt = (float)std::sqrt(1.0 - std::pow(BETA2, (double)step_));
+        const float stepSize = (float)(lr_ / (1.0 - std::pow(BETA1, (double)step_)));
+        size_t p = 0;
+#ifdef __AVX2__
+// Same operations in the same order as the scalar loop (bit-identical results).
+        const __m256 vBeta1 = _mm256_set1_ps(beta1), vKeep1 = _mm256_set1_ps(keep1);
+        const __m256 vBeta2 = _mm256_set1_ps(beta2), vKeep2 = _mm256_set1_ps(keep2);
+        const __m256 vCorrection2 = _mm256_set1_ps(correction2Sqrt);
+        const __m256 vStep = _mm256_set1_ps(stepSize), vEps = _mm256_set1_ps(EPS);
+        for (; p + 8 <= count_; p += 8) {
+            const __m256 g = _mm256_loadu_ps(&grads_[p]);
+            const __m256 m = _mm256_add_ps(_mm256_mul_ps(vBeta1, _mm256_loadu_ps(&m_[p])), _mm256_mul_ps(vKeep1, g));
+            const __m256 v = _mm256_add_ps(_mm256_mul_ps(vBeta2, _mm256_loadu_ps(&v_[p])),
+                                           _mm256_mul_ps(_mm256_mul_ps(vKeep2, g), g));
+            _mm256_storeu_ps(&m_[p], m);
+            _mm256_storeu_ps(&v_[p], v);
+            const __m256 denom = _mm256_add_ps(_mm256_div_ps(_mm256_sqrt_ps(v), vCorrection2), vEps);
+            const __m256 update = _mm256_div_ps(_mm256_mul_ps(vStep, m), denom);
+            _mm256_storeu_ps(&params_[p], _mm256_sub_ps(_mm256_loadu_ps(&params_[p]), update));
+        }
+#endif
+        for (; p < count_; p++) {
+            const float g = grads_[p];
+            m_[p] = beta1 * m_[p] + keep1 * g;
+            v_[p] = beta2 * v_[p] + keep2 * g * g;
+            params_[p] -= stepSize * m_[p] / (std::sqrt(v_[p]) / correction2Sqrt + EPS);
+        }
+    }
+
+    int in_, hidden_, out_;
+    float lr_;
+    float gamma_;
+    long long step_ = 0; // Adam steps taken.
+
+    size_t sizes_[TENSORS];
+    size_t offsets_[TENSORS];
+    size_t count_;
+
+    std::vector<float> params_;
+    std::vector<float> target_;
+    std::vector<float> grads_;
+    std::vector<float> m_; // Adam first moment.
+    std::vector<float> v_; // Adam second moment.
+
+// Scratch.
+    PolicyKernel policy_kernel_;
+    PolicyKernel target_kernel_;
+    int batch_ = 0;
+    int stride_ = 0; // row stride of a1_ / a2_ (hidden padded to 8).
+    std::vector<float> a1_, a2_, q_;
+    std::vector<float> d1_, d2_;
+    std::vector<float> dq_, targets_;
+    std::vector<int> next_actions_;
+};
+
+#endif // NATIVE_LEARNER_H
@@ -0,0 +1,250 @@
+#ifndef OBSERVATION_CODEC_H
+#define OBSERVATION_CODEC_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// F16C (half <-> float conversion) ships with every AVX2 CPU; GCC/Clang need -mf16c to use it,
+// MSVC exposes it with /arch:AVX2.
+#if defined(__AVX2__) && (defined(__F16C__) || defined(_MSC_VER))
+#define OBSERVATION_CODEC_F16C 1
+#endif
+
+// How observation rows are stored in the replay buffer.
+enum class ObservationEncoding {
+    Float32, // as is.
+    Float16, // IEEE half, ~3 significant digits.
+    Uint16, // affine over each feature's [lo, hi], step (hi - lo) / 65535.
+    Uint8 // affine over each feature's [lo, hi], step (hi - lo) / 255.
+};
+
+inline const char* ObservationEncodingName(ObservationEncoding encoding) {
+    switch (encoding) {
+        case ObservationEncoding::Float16: return "fp16";
+        case ObservationEncoding::Uint16: return "u16";
+        case ObservationEncoding::Uint8: return "u8";
+        default: return "fp32";
+    }
+}
+
+inline bool ParseObservationEncoding(const std::string& name, ObservationEncoding& encoding) {
+    if (name == "fp32") encoding = ObservationEncoding::Float32;
+    else if (name == "fp16") encoding = ObservationEncoding::Float16;
+    else if (name == "u16") encoding = ObservationEncoding::Uint16;
+    else if (name == "u8") encoding = ObservationEncoding::Uint8;
+    else return false;
+    return true;
+}
+
+// IEEE half conversion with round-to-nearest-even (same results as F16C).
+inline uint16_t FloatToHalf(float value) {
+    const uint32_t F32_INF = 255u << 23;
+    const uint32_t F16_MAX = (127u + 16u) << 23; // 2^16: rounds to inf.
+    const uint32_t DENORM_MAGIC = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    const uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint16_t half;
+    if (bits >= F16_MAX) {
+        half = (bits > F32_INF) ? 0x7e00 : 0x7c00;
+    } else if (bits < (113u << 23)) {
+// Half subnormal: let the float adder round the mantissa into place.
+        float f, magic;
+        std::memcpy(&f, &bits, 4);
+        std::memcpy(&magic, &DENORM_MAGIC, 4);
+        f += magic;
+        uint32_t rounded;
+        std::memcpy(&rounded, &f, 4);
+        half = (uint16_t)(rounded - DENORM_MAGIC);
+    } else {
+        const uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += ((15u - 127u) << 23) + 0xfff + mantissaOdd;
+        half = (uint16_t)(bits >> 13);
+    }
+    return (uint16_t)(half | (sign >> 16));
+}
+
+inline float HalfToFloat(uint16_t half) {
+    const uint32_t SHIFTED_EXP = 0x7c00u << 13;
+    uint32_t bits = ((uint32_t)half & 0x7fff) << 13;
+    const uint32_t exponent = bits & SHIFTED_EXP;
+    bits += (127u - 15u) << 23;
+    float value;
+    if (exponent == SHIFTED_EXP) {
+        bits += (128u - 16u) << 23; // inf / nan.
+        std::memcpy(&value, &bits, 4);
+    } else if (exponent == 0) {
+// Zero or subnormal: renormalize through a float subtraction.
+        bits += 1u << 23;
+        const uint32_t MAGIC = 113u << 23;
+        float magic;
+        std::memcpy(&value, &bits, 4);
+        std::memcpy(&magic, &MAGIC, 4);
+        value -= magic;
+    } else {
+        std::memcpy(&value, &bits, 4);
+    }
+    uint32_t out;
+    std::memcpy(&out, &value, 4);
+    out |= ((uint32_t)half & 0x8000) << 16;
+    std::memcpy(&value, &out, 4);
+    return value;
+}
+
+// Encodes float rows into a compact per-feature representation and decodes them back.
+// Integer encodings clamp each feature to its [lo, hi] range; decode is lo + q * step, eight
+// features per instruction with AVX2 (exact same result as the scalar loop, no FMA).
+class ObservationCodec {
+public:
+    ObservationCodec() = default;
+
+    // lo / hi (size entries) are only read by the integer encodings.
+    ObservationCodec(ObservationEncoding encoding, int size, const float* lo = nullptr, const float* hi = nullptr)
+        : encoding_(encoding), size_(size), lo_(size, 0.0f), step_(size, 1.0f), scale_(size, 1.0f) {
+        const float levels = (encoding == ObservationEncoding::Uint8) ? 255.0f : 65535.0f;
+        if (encoding == ObservationEncoding::Uint8 || encoding == ObservationEncoding::Uint16) {
+            for (int k = 0; k < size; k++) {
+                lo_[k] = lo[k];
+                step_[k] = (hi[k] - lo[k]) / levels;
+                scale_[k] = levels / (hi[k] - lo[k]);
+            }
+        }
+    }
+
+    ObservationEncoding encoding() const { return encoding_; }
+    int size() const { return size_; }
+    const float* lo() const { return lo_.data(); }
+    const float* step() const { return step_.data(); }
+
+    int FeatureBytes() const {
+        switch (encoding_) {
+            case ObservationEncoding::Float16: return 2;
+            case ObservationEncoding::Uint16: return 2;
+            case ObservationEncoding::Uint8: return 1;
+            default: return 4;
+        }
+    }
+    int RowBytes() const { return size_ * FeatureBytes(); }
+
+    // Largest decode error for feature k of an in-range value, up to float rounding
+    // (fp16: for |value| <= 1).
+    float MaxError(int k) const {
+        if (encoding_ == ObservationEncoding::Float32) return 0.0f;
+        if (encoding_ == ObservationEncoding::Float16) return 1.0f / 2048.0f;
+        return step_[k] * 0.5f;
+    }
+
+    void Encode(const float* in, uint8_t* out) const {
+        switch (encoding_) {
+            case ObservationEncoding::Float32:
+                std::memcpy(out, in, size_ * sizeof(float));
+                break;
+            case ObservationEncoding::Float16:
+                for (int k = 0; k < size_; k++) {
+                    uint16_t h = FloatToHalf(in[k]);
+                    std::memcpy(out + 2 * k, &h, 2);
+                }
+                break;
+            case ObservationEncoding::Uint16:
+                for (int k = 0; k < size_; k++) {
+                    uint16_t q = (uint16_t)Quantize(in[k], k, 65535.0f);
+                    std::memcpy(out + 2 * k, &q, 2);
+                }
+                break;
+            case ObservationEncoding::Uint8:
+                for (int k = 0; k < size_; k++) out[k] = (uint8_t)Quantize(in[k], k, 255.0f);
+                break;
+        }
+    }
+
+    void Decode(const uint8_t* in, float* out) const {
+        int k = 0;
+        switch (encoding_) {
+            case ObservationEncoding::Float32:
+                std::memcpy(out, in, size_ * sizeof(float));
+                return;
+            case ObservationEncoding::Float16:
+#ifdef OBSERVATION_CODEC_F16C
+                for (; k + 8 <= size_; k += 8) {
+                    __m128i h = _mm_loadu_si128((const __m128i*)(in + 2 * k));
+                    _mm256_storeu_ps(out + k, _mm256_cvtph_ps(h));
+                }
+// Tail: one more vector over the last eight features (recomputing a few), still inside the row.
+                if (k < size_ && size_ >= 8) {
+                    k = size_ - 8;
+                    _mm256_storeu_ps(out + k, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + 2 * k))));
+                    k = size_;
+                }
+#endif
+                for (; k < size_; k++) {
+                    uint16_t h;
+                    std::memcpy(&h, in + 2 * k, 2);
+                    out[k] = HalfToFloat(h);
+                }
+                return;
+            case ObservationEncoding::Uint16:
+#ifdef __AVX2__
+                for (; k + 8 <= size_; k += 8) {
+                    __m256i q = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + 2 * k)));
+                    __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(q), _mm256_loadu_ps(&step_[k]));
+                    _mm256_storeu_ps(out + k, _mm256_add_ps(_mm256_loadu_ps(&lo_[k]), v));
+                }
+                if (k < size_ && size_ >= 8) {
+                    k = size_ - 8;
+                    __m256i q = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + 2 * k)));
+                    __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(q), _mm256_loadu_ps(&step_[k]));
+                    _mm256_storeu_ps(out + k, _mm256_add_ps(_mm256_loadu_ps(&lo_[k]), v));
+                    k = size_;
+                }
+#endif
+                for (; k < size_; k++) {
+                    uint16_t q;
+                    std::memcpy(&q, in + 2 * k, 2);
+                    out[k] = lo_[k] + (float)q * step_[k];
+                }
+                return;
+            case ObservationEncoding::Uint8:
+#ifdef __AVX2__
+                for (; k + 8 <= size_; k += 8) {
+                    __m256i q = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + k)));
+                    __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(q), _mm256_loadu_ps(&step_[k]));
+                    _mm256_storeu_ps(out + k, _mm256_add_ps(_mm256_loadu_ps(&lo_[k]), v));
+                }
+                if (k < size_ && size_ >= 8) {
+                    k = size_ - 8;
+                    __m256i q = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + k)));
+                    __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(q), _mm256_loadu_ps(&step_[k]));
+                    _mm256_storeu_ps(out + k, _mm256_add_ps(_mm256_loadu_ps(&lo_[k]), v));
+                    k = size_;
+                }
+#endif
+                for (; k < size_; k++) out[k] = lo_[k] + (float)in[k] * step_[k];
+                return;
+        }
+    }
+
+private:
+    int Quantize(float value, int k, float levels) const {
+        float q = (value - lo_[k]) * scale_[k];
+        q = std::min(levels, std::max(0.0f, q));
+        return (int)std::lround(q);
+    }
+
+    ObservationEncoding encoding_ = ObservationEncoding::Float32;
+    int size_ = 0;
+    std::vector<float> lo_;
+    std::vector<float> step_;
+    std::vector<float> scale_;
+};
+
+#endif // OBSERVATION_CODEC_H
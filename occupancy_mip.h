@@ -0,0 +1,165 @@
+#ifndef OCCUPANCY_MIP_H
+#define OCCUPANCY_MIP_H
+
+#include "raylib.h"
+#include "surface_grid.h"
+#include "wall_mask.h"
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+// Min/max mip pyramid over the wall mask. Level k covers 2^k x 2^k pixel blocks, starting at
+// k = 3 (one mask tile). Each cell stores whether its block has any solid pixel (max) and
+// whether it is entirely solid (min). Rays skip every lattice sample inside the largest empty
+// block around them and only fall back to the 2px mask march near walls, so the cost of a long
+// ray depends on how many walls it passes rather than on its length.
+struct OccupancyMip {
+    static constexpr int PAD = WallMask::PAD;
+    static constexpr int FIRST_LEVEL = 3; // 8x8 px, one WallMask tile.
+
+    enum : uint8_t {
+        ANY_SOLID = 1, // max over the block.
+        ALL_SOLID = 2  // min over the block.
+    };
+
+    WallMask mask;
+    std::vector<std::vector<uint8_t>> levels; // levels[i] is level FIRST_LEVEL + i, row-major.
+    std::vector<int> levelWidth;
+    std::vector<int> levelHeight;
+
+    int width = 0;
+    int height = 0;
+
+    int LevelCount() const { return (int)levels.size(); }
+
+// Flags of the level-(FIRST_LEVEL + i) block containing padded pixel (ux, uy).
+    uint8_t FlagsAt(int i, uint32_t ux, uint32_t uy) const {
+        const int shift = FIRST_LEVEL + i;
+        return levels[i][(size_t)(uy >> shift) * levelWidth[i] + (ux >> shift)];
+    }
+
+    size_t Bytes() const {
+        size_t bytes = mask.Bytes();
+        for (const std::vector<uint8_t>& level : levels) bytes += level.size();
+        return bytes;
+    }
+};
+
+inline OccupancyMip BuildOccupancyMip(const SurfaceGrid& grid) {
+    OccupancyMip mip;
+    mip.mask = BuildWallMask(grid);
+    mip.width = grid.width;
+    mip.height = grid.height;
+
+// Level 3 straight from the mask tiles.
+    const WallMask& mask = mip.mask;
+    std::vector<uint8_t> base((size_t)mask.tilesX * mask.tilesY);
+    for (int ty = 0; ty < mask.tilesY; ty++) {
+        for (int tx = 0; tx < mask.tilesX; tx++) {
+            uint64_t tile = mask.tiles[WallMask::TileIndex(tx, ty)];
+            uint8_t flags = 0;
+            if (tile != 0) flags |= OccupancyMip::ANY_SOLID;
+            if (tile == ~0ull) flags |= OccupancyMip::ALL_SOLID;
+            base[(size_t)ty * mask.tilesX + tx] = flags;
+        }
+    }
+    mip.levels.push_back(std::move(base));
+    mip.levelWidth.push_back(mask.tilesX);
+    mip.levelHeight.push_back(mask.tilesY);
+
+// Coarser levels: OR of "any", AND of "all" over 2x2 children. Children past the edge are
+// outside the padded grid and count as solid.
+    while (mip.levelWidth.back() > 1 || mip.levelHeight.back() > 1) {
+        const std::vector<uint8_t>& fine = mip.levels.back();
+        const int fw = mip.levelWidth.back();
+        const int fh = mip.levelHeight.back();
+        const int cw = (fw + 1) / 2;
+        const int ch = (fh + 1) / 2;
+
+        std::vector<uint8_t> coarse((size_t)cw * ch);
+        for (int y = 0; y < ch; y++) {
+            for (int x = 0; x < cw; x++) {
+                uint8_t any = 0;
+                uint8_t all = OccupancyMip::ALL_SOLID;
+                for (int j = 0; j < 2; j++) {
+                    for (int i = 0; i < 2; i++) {
+                        int fx = 2 * x + i;
+                        int fy = 2 * y + j;
+                        uint8_t flags = (fx < fw && fy < fh)
+                            ? fine[(size_t)fy * fw + fx]
+                            : (uint8_t)(OccupancyMip::ANY_SOLID | OccupancyMip::ALL_SOLID);
+                        any |= flags & OccupancyMip::ANY_SOLID;
+                        all &= flags;
+                    }
+                }
+                coarse[(size_t)y * cw + x] = any | (all & OccupancyMip::ALL_SOLID);
+            }
+        }
+        mip.levels.push_back(std::move(coarse));
+        mip.levelWidth.push_back(cw);
+        mip.levelHeight.push_back(ch);
+    }
+    return mip;
+}
+
+// LIDAR ray cast with empty-block skipping. Visits the same 2px lattice as the march and
+// returns identical distances: only samples that lie inside an empty block (shrunk by a small
+// margin that absorbs the float rounding of the sample position) are skipped.
+inline float CastLIDARRay(const OccupancyMip& mip, Vector2 position, float angle, float maxDistance) {
+    const int PAD = OccupancyMip::PAD;
+    const double MARGIN = 0.01;
+    float distance = 0.0f;
+    const float step = 2.0f;
+
+    const auto cosA = cos(angle);
+    const auto sinA = sin(angle);
+    const double invX = (cosA != 0) ? 1.0 / cosA : 0.0;
+    const double invY = (sinA != 0) ? 1.0 / sinA : 0.0;
+
+    while (distance < maxDistance) {
+        float checkX = position.x + cosA * distance;
+        float checkY = position.y + sinA * distance;
+        int x = (int)checkX;
+        int y = (int)checkY;
+        uint32_t ux = (uint32_t)(x + PAD);
+        uint32_t uy = (uint32_t)(y + PAD);
+
+// Level 3 is the mask tile itself: a non-empty tile is resolved per pixel.
+        uint64_t tile = mip.mask.TileAt(ux, uy);
+        if (tile != 0) {
+            if (WallMask::TileBit(tile, ux, uy)) return distance;
+            distance += step;
+            continue;
+        }
+
+// Largest empty block around the sample. A lone empty tile only holds a few samples,
+// not worth the exit computation.
+        int level = 0;
+        while (level + 1 < mip.LevelCount() && !(mip.FlagsAt(level + 1, ux, uy) & OccupancyMip::ANY_SOLID)) level++;
+        if (level == 0) {
+            distance += step;
+            continue;
+        }
+
+        const int shift = OccupancyMip::FIRST_LEVEL + level;
+        const double size = (double)(1 << shift);
+        const double x0 = (double)((ux >> shift) << shift) - PAD;
+        const double y0 = (double)((uy >> shift) << shift) - PAD;
+
+        double tExit = 1e30;
+        if (cosA > 0) tExit = fmin(tExit, (x0 + size - MARGIN - position.x) * invX);
+        if (cosA < 0) tExit = fmin(tExit, (x0 + MARGIN - position.x) * invX);
+        if (sinA > 0) tExit = fmin(tExit, (y0 + size - MARGIN - position.y) * invY);
+        if (sinA < 0) tExit = fmin(tExit, (y0 + MARGIN - position.y) * invY);
+
+// Every lattice sample up to tExit is clear; continue with the first one past it.
+        double skipped = floor((tExit - distance) / step);
+        if (skipped < 0.0) skipped = 0.0;
+        distance += (float)(skipped + 1.0) * step;
+    }
+
+    return maxDistance;
+}
+
+#endif // OCCUPANCY_MIP_H
@@ -0,0 +1,213 @@
+#ifndef POLICY_KERNEL_H
+#define POLICY_KERNEL_H
+
+#include <new>
+#include <memory>
+#include <cstring>
+#include <cstddef>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// FMA ships with every AVX2 CPU. The build keeps -mfma off so the physics is not contracted,
+// so GCC/Clang enable it for the kernel functions only (MSVC allows the intrinsic anyway).
+#if defined(__AVX2__) && defined(__GNUC__) && !defined(__FMA__)
+#define POLICY_KERNEL_TARGET __attribute__((target("fma")))
+#else
+#define POLICY_KERNEL_TARGET
+#endif
+
+// y[0..n) += a * x[0..n) (FMA with AVX2).
+POLICY_KERNEL_TARGET
+inline void Axpy(int n, float a, const float* x, float* y) {
+    int k = 0;
+#ifdef __AVX2__
+    const __m256 va = _mm256_set1_ps(a);
+    for (; k + 8 <= n; k += 8) {
+        _mm256_storeu_ps(y + k, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + k), _mm256_loadu_ps(y + k)));
+    }
+#endif
+    for (; k < n; k++) y[k] += a * x[k];
+}
+
+// y[0..n) = a * x[0..n) + b * y[0..n), e.g. the polyak target update. Deliberately without FMA
+// (and not under POLICY_KERNEL_TARGET): every build rounds exactly like torch's tau * p + (1 - tau) * t.
+inline void Axpby(size_t n, float a, const float* x, float b, float* y) {
+    size_t k = 0;
+#ifdef __AVX2__
+    const __m256 va = _mm256_set1_ps(a);
+    const __m256 vb = _mm256_set1_ps(b);
+    for (; k + 8 <= n; k += 8) {
+        __m256 ax = _mm256_mul_ps(va, _mm256_loadu_ps(x + k));
+        _mm256_storeu_ps(y + k, _mm256_add_ps(ax, _mm256_mul_ps(vb, _mm256_loadu_ps(y + k))));
+    }
+#endif
+    for (; k < n; k++) y[k] = a * x[k] + b * y[k];
+}
+
+// y = W x + b (ReLU if relu) for one row through a layer packed as wt[in][outp], outp a
+// multiple of 8 (b and y padded to outp). Each 8-wide output block accumulates
+// broadcast(x[k]) * W[k] in four independent chains (FMAs with AVX2, an 8-float block the
+// compiler keeps in registers without).
+POLICY_KERNEL_TARGET
+inline void DenseLayer(const float* x, int in, const float* wt, const float* b, int outp, float* y, bool relu) {
+    for (int j = 0; j < outp; j += 8) {
+        const float* w = wt + j;
+#ifdef __AVX2__
+        __m256 acc0 = _mm256_loadu_ps(b + j);
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        int k = 0;
+        for (; k + 4 <= in; k += 4) {
+            acc0 = _mm256_fmadd_ps(_mm256_set1_ps(x[k]), _mm256_loadu_ps(w + (size_t)k * outp), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_set1_ps(x[k + 1]), _mm256_loadu_ps(w + (size_t)(k + 1) * outp), acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_set1_ps(x[k + 2]), _mm256_loadu_ps(w + (size_t)(k + 2) * outp), acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_set1_ps(x[k + 3]), _mm256_loadu_ps(w + (size_t)(k + 3) * outp), acc3);
+        }
+        for (; k < in; k++) {
+            acc0 = _mm256_fmadd_ps(_mm256_set1_ps(x[k]), _mm256_loadu_ps(w + (size_t)k * outp), acc0);
+        }
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+        if (relu) sum = _mm256_max_ps(sum, _mm256_setzero_ps());
+        _mm256_storeu_ps(y + j, sum);
+#else
+        float acc[8];
+        for (int t = 0; t < 8; t++) acc[t] = b[j + t];
+        for (int k = 0; k < in; k++) {
+            const float xk = x[k];
+            const float* wk = w + (size_t)k * outp;
+            for (int t = 0; t < 8; t++) acc[t] += xk * wk[t];
+        }
+        for (int t = 0; t < 8; t++) y[j + t] = (relu && acc[t] < 0.0f) ? 0.0f : acc[t];
+#endif
+    }
+}
+
+// Dependency-free inference for the DQN policy MLP (in -> h1 -> h2 -> out, ReLU between).
+// Load copies torch Linear weights ([out, in] row-major) into one 32-byte aligned block,
+// transposed to [in][out] with every layer width padded to a multiple of 8 (zero weights and
+// biases, so padded units stay 0), about 24 KB for 23-64-64-7, i.e. L1-resident.
+// A row runs all three layers (DenseLayer) and the argmax without leaving the kernel; AVX2 and
+// scalar builds both match torch within float rounding.
+// Forward/Act use member scratch, so each thread needs its own kernel.
+class PolicyKernel {
+public:
+    static const char* Path() {
+#ifdef __AVX2__
+        return "AVX2+FMA";
+#else
+        return "scalar";
+#endif
+    }
+
+    bool loaded() const { return in_ > 0; }
+    int input_size() const { return in_; }
+    int output_size() const { return out_; }
+    int hidden1_stride() const { return h1p_; }
+    int hidden2_stride() const { return h2p_; }
+
+    void Load(int in, int h1, int h2, int out,
+              const float* w1, const float* b1, const float* w2, const float* b2,
+              const float* w3, const float* b3) {
+        const int h1p = Pad(h1), h2p = Pad(h2), outp = Pad(out);
+        const size_t floats = (size_t)in * h1p + h1p + (size_t)h1p * h2p + h2p + (size_t)h2p * outp + outp +
+                              h1p + h2p + outp;
+        if (floats != floats_) {
+            block_.reset(static_cast<float*>(::operator new[](floats * sizeof(float), std::align_val_t(32))));
+            floats_ = floats;
+        }
+        in_ = in; h1_ = h1; h2_ = h2; out_ = out;
+        h1p_ = h1p; h2p_ = h2p; outp_ = outp;
+        std::memset(block_.get(), 0, floats * sizeof(float));
+
+        float* p = block_.get();
+        w1t_ = p; p += (size_t)in * h1p;
+        b1_ = p; p += h1p;
+        w2t_ = p; p += (size_t)h1p * h2p;
+        b2_ = p; p += h2p;
+        w3t_ = p; p += (size_t)h2p * outp;
+        b3_ = p; p += outp;
+        a1_ = p; p += h1p;
+        a2_ = p; p += h2p;
+        q_ = p;
+
+        Pack(w1, b1, in, h1, h1p, w1t_, b1_);
+        Pack(w2, b2, h1, h2, h2p, w2t_, b2_);
+        Pack(w3, b3, h2, out, outp, w3t_, b3_);
+    }
+
+    // Load from flat parameters in the torch module's parameters() order (fc1.weight, fc1.bias,
+    // fc2.weight, fc2.bias, fc3.weight, fc3.bias), as DQN::read_parameters and NativeLearner
+    // keep them; both hidden layers hidden wide.
+    void LoadFlat(int in, int hidden, int out, const float* params) {
+        const float* w1 = params;
+        const float* b1 = w1 + (size_t)hidden * in;
+        const float* w2 = b1 + hidden;
+        const float* b2 = w2 + (size_t)hidden * hidden;
+        const float* w3 = b2 + hidden;
+        const float* b3 = w3 + (size_t)out * hidden;
+        Load(in, hidden, hidden, out, w1, b1, w2, b2, w3, b3);
+    }
+
+    // Q-values for n rows: states is n x input_size, q_out receives n x output_size.
+    void Forward(const float* states, int n, float* q_out) {
+        for (int i = 0; i < n; i++) {
+            Row(states + (size_t)i * in_, a1_, a2_);
+            std::memcpy(q_out + (size_t)i * out_, q_, out_ * sizeof(float));
+        }
+    }
+
+    // Forward that also keeps every row's hidden activations for backprop: h1_out receives
+    // n x hidden1_stride(), h2_out n x hidden2_stride() floats (padding units are 0).
+    void Forward(const float* states, int n, float* q_out, float* h1_out, float* h2_out) {
+        for (int i = 0; i < n; i++) {
+            Row(states + (size_t)i * in_, h1_out + (size_t)i * h1p_, h2_out + (size_t)i * h2p_);
+            std::memcpy(q_out + (size_t)i * out_, q_, out_ * sizeof(float));
+        }
+    }
+
+    // Greedy action per row (first maximum on ties).
+    void Act(const float* states, int n, int* actions) {
+        for (int i = 0; i < n; i++) {
+            Row(states + (size_t)i * in_, a1_, a2_);
+            int best = 0;
+            for (int a = 1; a < out_; a++) {
+                if (q_[a] > q_[best]) best = a;
+            }
+            actions[i] = best;
+        }
+    }
+
+private:
+    struct AlignedDelete {
+        void operator()(float* p) const { ::operator delete[](p, std::align_val_t(32)); }
+    };
+
+    static int Pad(int n) { return (n + 7) & ~7; }
+
+    static void Pack(const float* w, const float* b, int in, int out, int outp, float* wt, float* bp) {
+        for (int j = 0; j < out; j++) {
+            for (int k = 0; k < in; k++) wt[(size_t)k * outp + j] = w[(size_t)j * in + k];
+            bp[j] = b[j];
+        }
+    }
+
+    void Row(const float* x, float* a1, float* a2) {
+        DenseLayer(x, in_, w1t_, b1_, h1p_, a1, true);
+        DenseLayer(a1, h1p_, w2t_, b2_, h2p_, a2, true);
+        DenseLayer(a2, h2p_, w3t_, b3_, outp_, q_, false);
+    }
+
+    std::unique_ptr<float[], AlignedDelete> block_;
+    size_t floats_ = 0;
+    int in_ = 0, h1_ = 0, h2_ = 0, out_ = 0;
+    int h1p_ = 0, h2p_ = 0, outp_ = 0;
+    float* w1t_ = nullptr; float* b1_ = nullptr;
+    float* w2t_ = nullptr; float* b2_ = nullptr;
+    float* w3t_ = nullptr; float* b3_ = nullptr;
+    float* a1_ = nullptr; float* a2_ = nullptr; float* q_ = nullptr; // per-row scratch.
+};
+
+#endif // POLICY_KERNEL_H
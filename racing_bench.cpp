@@ -0,0 +1,2222 @@
+// racing_bench.cpp.
+// Micro-benchmarks for the simulator and learner hot paths.
+// Usage: racing_bench <lidar|lut|alloc|replay [capacity...]|per [capacity...]|learner [batch...]|rng|mpreplay [producers...]|mmreplay [capacity [fill]]|quant|nstep|inference [n...]|native [batch...]|params|async [envs...]>
+#include "raylib.h"
+#include "racing_env.h"
+#include "surface_grid.h"
+#include "distance_field.h"
+#include "wall_mask.h"
+#include "occupancy_mip.h"
+#include "lidar.h"
+#include "lidar_simd.h"
+#include "lidar_table.h"
+#include "racing_sim.h"
+#include "vec_env.h"
+#include "replay_buffer.h"
+#include "concurrent_replay_buffer.h"
+#include "observation_codec.h"
+#include "n_step.h"
+#include "sum_tree.h"
+#include "rng.h"
+#include "dqn.h"
+#include "batch_prefetcher.h"
+#include "async_learner.h"
+
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <mutex>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Every heap allocation in the process goes through here (alloc mode counts them).
+static std::atomic<long long> g_heapAllocations{0};
+
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+BENCH_NOINLINE void* operator new(size_t size) {
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+BENCH_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+struct RaySample {
+    Vector2 position;
+    float angle;
+    float range;
+};
+
+// Random rays from open (non-wall) pixels, half short-range and half anticipation-range.
+static std::vector<RaySample> MakeRaySamples(const Image& trackImage, int count, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> ux(0.0f, (float)trackImage.width);
+    std::uniform_real_distribution<float> uy(0.0f, (float)trackImage.height);
+    std::uniform_real_distribution<float> ua(-PI, PI);
+
+    std::vector<RaySample> rays;
+    rays.reserve(count);
+    while ((int)rays.size() < count) {
+        Vector2 p = {ux(gen), uy(gen)};
+        if (IsWall(GetImageColor(trackImage, (int)p.x, (int)p.y))) continue;
+        float range = (rays.size() % 2 == 0) ? 200.0f : 900.0f;
+        rays.push_back({p, ua(gen), range});
+    }
+    return rays;
+}
+
+// Casts every ray with `cast`, repeated until at least minSeconds elapsed; returns rays/sec.
+template <class CastFn>
+static double TimeRays(const std::vector<RaySample>& rays, std::vector<float>& out, CastFn cast,
+                       double minSeconds = 1.0) {
+    out.resize(rays.size());
+    long long total = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        for (size_t i = 0; i < rays.size(); i++) {
+            out[i] = cast(rays[i]);
+        }
+        total += (long long)rays.size();
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    return (double)total / elapsed;
+}
+
+static void PrintRate(const std::string& name, double raysPerSec, double baseline) {
+    std::cout << "  " << std::left << std::setw(24) << name
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << raysPerSec / 1e6 << " Mrays/s"
+              << std::setw(9) << std::setprecision(1) << raysPerSec / baseline << "x\n";
+}
+
+static float MaxAbsDiff(const std::vector<float>& a, const std::vector<float>& b) {
+    float worst = 0.0f;
+    for (size_t i = 0; i < a.size(); i++) worst = std::max(worst, std::fabs(a[i] - b[i]));
+    return worst;
+}
+
+// Hardware cache counters via perf_event_open (Linux only; reports n/a when unavailable,
+// e.g. with kernel.perf_event_paranoid > 2 or inside containers).
+class PerfCounter {
+public:
+    PerfCounter(uint32_t type, uint64_t config) {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        (void)type;
+        (void)config;
+#endif
+    }
+
+    ~PerfCounter() {
+#ifdef __linux__
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    bool ok() const { return fd_ >= 0; }
+
+    void start() {
+#ifdef __linux__
+        if (fd_ < 0) return;
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    long long stop() {
+        long long value = -1;
+#ifdef __linux__
+        if (fd_ < 0) return -1;
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd_, &value, sizeof(value)) != (ssize_t)sizeof(value)) value = -1;
+#endif
+        return value;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+// L1D read misses and last-level-cache misses per ray for one caster.
+template <class CastFn>
+static void PrintCacheMisses(const std::string& name, const std::vector<RaySample>& rays, CastFn cast) {
+#ifdef __linux__
+    PerfCounter l1(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                   (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    PerfCounter llc(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#else
+    PerfCounter l1(0, 0);
+    PerfCounter llc(0, 0);
+#endif
+    const int PASSES = 10;
+    volatile float sink = 0.0f;
+
+    l1.start();
+    llc.start();
+    for (int p = 0; p < PASSES; p++) {
+        for (const RaySample& r : rays) sink = sink + cast(r);
+    }
+    long long l1Misses = l1.stop();
+    long long llcMisses = llc.stop();
+
+    double n = (double)rays.size() * PASSES;
+    std::cout << "  " << std::left << std::setw(24) << name << std::right;
+    if (l1Misses >= 0) std::cout << std::fixed << std::setprecision(2) << std::setw(10) << l1Misses / n << " L1D miss/ray";
+    else std::cout << std::setw(10) << "n/a" << " L1D miss/ray";
+    if (llcMisses >= 0) std::cout << std::fixed << std::setprecision(3) << std::setw(10) << llcMisses / n << " LLC miss/ray";
+    else std::cout << std::setw(10) << "n/a" << " LLC miss/ray";
+    std::cout << "\n";
+}
+
+// Nearest-neighbour upscale of a baked grid, standing in for a larger track image.
+static SurfaceGrid ScaleSurfaceGrid(const SurfaceGrid& grid, int scale) {
+    SurfaceGrid scaled;
+    scaled.width = grid.width * scale;
+    scaled.height = grid.height * scale;
+    scaled.stride = scaled.width + 2 * SurfaceGrid::PAD;
+    scaled.cells.assign((size_t)scaled.stride * (scaled.height + 2 * SurfaceGrid::PAD) + SurfaceGrid::GATHER_SLACK,
+                        SURFACE_OUT);
+    for (int y = 0; y < scaled.height; y++) {
+        for (int x = 0; x < scaled.width; x++) {
+            scaled.cells[(size_t)(y + SurfaceGrid::PAD) * scaled.stride + (x + SurfaceGrid::PAD)] =
+                grid.At(x / scale, y / scale);
+        }
+    }
+    return scaled;
+}
+
+// Long rays on the track scaled 1x/2x/4x (range scaled with it): mask march vs mip skipping.
+static void BenchLongRays(const Image& trackImage, const SurfaceGrid& grid) {
+    std::cout << "Anticipation rays vs range (track and range scaled together):\n";
+    std::vector<RaySample> base = MakeRaySamples(trackImage, 4000, 7u);
+    const int scales[] = { 1, 2, 4 };
+    for (int scale : scales) {
+        SurfaceGrid scaled = (scale == 1) ? grid : ScaleSurfaceGrid(grid, scale);
+
+        auto buildStart = std::chrono::steady_clock::now();
+        OccupancyMip mip = BuildOccupancyMip(scaled);
+        double mipMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+        std::vector<RaySample> rays;
+        for (const RaySample& r : base) {
+            rays.push_back({{r.position.x * scale, r.position.y * scale}, r.angle, LONG_RANGE * scale});
+        }
+
+        std::vector<float> marched, skipped;
+        double marchRate = TimeRays(rays, marched, [&](const RaySample& r) {
+            return CastLIDARRay(mip.mask, r.position, r.angle, r.range);
+        }, 0.5);
+        double mipRate = TimeRays(rays, skipped, [&](const RaySample& r) {
+            return CastLIDARRay(mip, r.position, r.angle, r.range);
+        }, 0.5);
+
+        std::cout << "  " << scaled.width << "x" << scaled.height << ", range " << (int)(LONG_RANGE * scale)
+                  << "px: mip " << mip.LevelCount() << " levels, " << mip.Bytes() / 1024 << " KB, "
+                  << std::fixed << std::setprecision(1) << mipMs << " ms\n";
+        PrintRate("    mask march", marchRate, marchRate);
+        PrintRate("    mip", mipRate, marchRate);
+        std::cout << "      max |d - march| = " << MaxAbsDiff(skipped, marched) << " px\n";
+    }
+}
+
+static int BenchLidar(const Image& trackImage) {
+    const int RAY_COUNT = 20000;
+    std::vector<RaySample> rays = MakeRaySamples(trackImage, RAY_COUNT, 1234u);
+
+    auto buildStart = std::chrono::steady_clock::now();
+    SurfaceGrid grid = BakeSurfaceGrid(trackImage);
+    double gridMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+    buildStart = std::chrono::steady_clock::now();
+    DistanceField field = BuildDistanceField(grid);
+    double fieldMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+    std::cout << "=== LIDAR ray casting (" << RAY_COUNT << " rays, 200/900px) ===\n";
+    std::cout << "Surface grid bake:    " << std::fixed << std::setprecision(1) << gridMs << " ms, "
+              << grid.cells.size() / 1024 << " KB\n";
+    std::cout << "Distance field build: " << std::fixed << std::setprecision(1) << fieldMs << " ms, "
+              << (field.dist.size() * sizeof(float)) / 1024 << " KB\n";
+
+    buildStart = std::chrono::steady_clock::now();
+    WallMask mask = BuildWallMask(grid);
+    double maskMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+    std::cout << "Wall mask build:      " << std::fixed << std::setprecision(1) << maskMs << " ms, "
+              << mask.Bytes() / 1024 << " KB (image: "
+              << (size_t)trackImage.width * trackImage.height * 4 / 1024 << " KB)\n";
+
+    std::vector<float> reference, result;
+
+    double marchRate = TimeRays(rays, reference, [&](const RaySample& r) {
+        return CastLIDARRay(trackImage, r.position, r.angle, r.range);
+    });
+    PrintRate("image march (2px)", marchRate, marchRate);
+
+    double gridRate = TimeRays(rays, result, [&](const RaySample& r) {
+        return CastLIDARRay(grid, r.position, r.angle, r.range);
+    });
+    PrintRate("surface grid march", gridRate, marchRate);
+    std::cout << "    max |d - march| = " << MaxAbsDiff(result, reference) << " px\n";
+
+    double fieldRate = TimeRays(rays, result, [&](const RaySample& r) {
+        return CastLIDARRay(field, r.position, r.angle, r.range);
+    });
+    PrintRate("distance field", fieldRate, marchRate);
+    std::cout << "    max |d - march| = " << MaxAbsDiff(result, reference) << " px\n";
+
+    double maskRate = TimeRays(rays, result, [&](const RaySample& r) {
+        return CastLIDARRay(mask, r.position, r.angle, r.range);
+    });
+    PrintRate("wall mask (1 bit/px)", maskRate, marchRate);
+    std::cout << "    max |d - march| = " << MaxAbsDiff(result, reference) << " px\n";
+
+// The 13 short + 5 long rays GetState casts, from random poses, per runtime-selectable caster.
+    std::vector<RaySample> poses = MakeRaySamples(trackImage, RAY_COUNT / 18, 99u);
+    std::vector<RaySample> stateRays;
+    for (const RaySample& p : poses) {
+        for (float off : LIDAR_SHORT_OFFSETS) stateRays.push_back({p.position, p.angle + off, LIDAR_RANGE});
+        for (float off : LIDAR_LONG_OFFSETS) stateRays.push_back({p.position, p.angle + off, LONG_RANGE});
+    }
+
+    std::cout << "GetState rays (" << poses.size() << " poses x 18 rays), LidarSensor modes:\n";
+    std::vector<float> stateReference;
+    double stateBaseline = 0.0;
+    const LidarMode modes[] = { LidarMode::March, LidarMode::DistanceField, LidarMode::WallMask, LidarMode::DDA,
+                                LidarMode::Mip };
+    for (LidarMode mode : modes) {
+        LidarSensor sensor(grid, mode);
+        std::vector<float>& out = (mode == LidarMode::March) ? stateReference : result;
+        double rate = TimeRays(stateRays, out, [&](const RaySample& r) {
+            return sensor.Cast(r.position, r.angle, r.range);
+        });
+        if (mode == LidarMode::March) stateBaseline = rate;
+        PrintRate(LidarModeName(mode), rate, stateBaseline);
+        if (mode == LidarMode::March) continue;
+
+        double sumDiff = 0.0;
+        int beyondStep = 0;
+        for (size_t i = 0; i < out.size(); i++) {
+            float diff = std::fabs(out[i] - stateReference[i]);
+            sumDiff += diff;
+            if (diff > 2.0f) beyondStep++;
+        }
+        std::cout << "    max |d - march| = " << std::setprecision(2) << MaxAbsDiff(out, stateReference)
+                  << " px, mean = " << sumDiff / out.size()
+                  << " px, > 2px (march skipped a corner): " << beyondStep << "\n";
+    }
+
+// Same rays through the batched kernel (directions precomputed once, AVX2 lanes when built in).
+    std::vector<float> ox, oy, maxD;
+    std::vector<double> cosD, sinD;
+    for (const RaySample& r : stateRays) {
+        ox.push_back(r.position.x);
+        oy.push_back(r.position.y);
+        cosD.push_back(cos(r.angle));
+        sinD.push_back(sin(r.angle));
+        maxD.push_back(r.range);
+    }
+    result.assign(stateRays.size(), 0.0f);
+    long long batchTotal = 0;
+    auto batchStart = std::chrono::steady_clock::now();
+    double batchElapsed = 0.0;
+    do {
+        CastLIDARRays(grid, ox.data(), oy.data(), cosD.data(), sinD.data(), maxD.data(),
+                      result.data(), (int)stateRays.size());
+        batchTotal += (long long)stateRays.size();
+        batchElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    } while (batchElapsed < 1.0);
+#ifdef __AVX2__
+    const char* batchName = LIDAR_TRIG_IS_DOUBLE ? "simd (AVX2 x8)" : "simd (scalar)";
+#else
+    const char* batchName = "simd (scalar build)";
+#endif
+    PrintRate(batchName, batchTotal / batchElapsed, stateBaseline);
+    std::cout << "    max |d - march| = " << MaxAbsDiff(result, stateReference) << " px\n";
+
+// Full observations: LidarBatch for all poses at once vs per-pose GetState.
+    std::vector<float> px, py, pa, ps;
+    for (const RaySample& p : poses) {
+        px.push_back(p.position.x);
+        py.push_back(p.position.y);
+        pa.push_back(p.angle);
+        ps.push_back(150.0f);
+    }
+    LidarBatch batch;
+    std::vector<float> batchStates(poses.size() * LidarBatch::STATE_SIZE);
+    batch.ComputeStates(grid, px.data(), py.data(), pa.data(), ps.data(), (int)poses.size(), batchStates.data());
+    float worstState = 0.0f;
+    for (size_t c = 0; c < poses.size(); c++) {
+        std::vector<float> state = GetState(grid, poses[c].position, poses[c].angle, ps[c]);
+        for (int k = 0; k < LidarBatch::STATE_SIZE; k++) {
+            worstState = std::max(worstState, std::fabs(state[k] - batchStates[c * LidarBatch::STATE_SIZE + k]));
+        }
+    }
+    std::cout << "  LidarBatch states vs GetState: max |diff| = " << worstState << "\n";
+
+    BenchLongRays(trackImage, grid);
+
+    std::cout << "Cache misses (perf counters):\n";
+    PrintCacheMisses("image march (2px)", rays, [&](const RaySample& r) {
+        return CastLIDARRay(trackImage, r.position, r.angle, r.range);
+    });
+    PrintCacheMisses("surface grid march", rays, [&](const RaySample& r) {
+        return CastLIDARRay(grid, r.position, r.angle, r.range);
+    });
+    PrintCacheMisses("wall mask (1 bit/px)", rays, [&](const RaySample& r) {
+        return CastLIDARRay(mask, r.position, r.angle, r.range);
+    });
+
+    return 0;
+}
+
+// Error summary of approximate distances vs the march: max, mean and 99th percentile.
+static void PrintErrorStats(const std::string& name, const std::vector<float>& approx, const std::vector<float>& exact) {
+    std::vector<float> err(approx.size());
+    double sum = 0.0;
+    for (size_t i = 0; i < approx.size(); i++) {
+        err[i] = std::fabs(approx[i] - exact[i]);
+        sum += err[i];
+    }
+    std::sort(err.begin(), err.end());
+    std::cout << "    " << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(3)
+              << "max " << err.back() << ", mean " << sum / err.size()
+              << ", p99 " << err[(size_t)(err.size() * 0.99)] << "\n";
+}
+
+static int BenchLidarTable(const Image& trackImage) {
+    SurfaceGrid grid = BakeSurfaceGrid(trackImage);
+    const std::string path = "racing_bench_lidar.lut";
+    std::remove(path.c_str());
+
+    std::cout << "=== Precomputed LIDAR table (" << LidarTable::CELL << "px cells, "
+              << LidarTable::BINS << " heading bins, uint16 / " << LidarTable::SCALE << " px) ===\n";
+
+    auto start = std::chrono::steady_clock::now();
+    double buildSeconds = 0.0;
+    size_t bytes = 0;
+    {
+        LidarTable table;
+        if (!table.LoadOrBuild(grid, path)) return 1;
+        buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        bytes = table.Bytes();
+    }
+
+    start = std::chrono::steady_clock::now();
+    LidarTable table;
+    table.LoadOrBuild(grid, path);
+    double mapMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Build: " << std::fixed << std::setprecision(2) << buildSeconds << " s, size "
+              << bytes / (1024 * 1024) << " MB; remap: " << std::setprecision(3) << mapMs << " ms\n";
+
+// GetState rays from random poses (anywhere on open track, not on table nodes).
+    std::vector<RaySample> poses = MakeRaySamples(trackImage, 20000, 4321u);
+    std::vector<RaySample> shortRays, longRays;
+    for (const RaySample& p : poses) {
+        for (float off : LIDAR_SHORT_OFFSETS) shortRays.push_back({p.position, p.angle + off, LIDAR_RANGE});
+        for (float off : LIDAR_LONG_OFFSETS) longRays.push_back({p.position, p.angle + off, LONG_RANGE});
+    }
+    std::vector<RaySample> allRays = shortRays;
+    allRays.insert(allRays.end(), longRays.begin(), longRays.end());
+
+    std::vector<float> exact, approx;
+    double marchRate = TimeRays(allRays, exact, [&](const RaySample& r) {
+        return CastLIDARRay(grid, r.position, r.angle, r.range);
+    });
+    PrintRate("surface grid march", marchRate, marchRate);
+    double tableRate = TimeRays(allRays, approx, [&](const RaySample& r) {
+        return table.Cast(r.position, r.angle, r.range);
+    });
+    PrintRate("table lookup", tableRate, marchRate);
+
+    std::cout << "  Interpolation error vs CastLIDARRay (px):\n";
+    std::vector<float> exactShort(exact.begin(), exact.begin() + shortRays.size());
+    std::vector<float> approxShort(approx.begin(), approx.begin() + shortRays.size());
+    std::vector<float> exactLong(exact.begin() + shortRays.size(), exact.end());
+    std::vector<float> approxLong(approx.begin() + shortRays.size(), approx.end());
+    PrintErrorStats("short rays (200px)", approxShort, exactShort);
+    PrintErrorStats("long rays (900px)", approxLong, exactLong);
+
+// The same error in observation units (danger and normalized long distance).
+    std::vector<float> featExact, featApprox;
+    for (size_t c = 0; c < poses.size(); c++) {
+        std::vector<float> a = GetState(grid, poses[c].position, poses[c].angle, 0.0f);
+        std::vector<float> b = GetState(table, poses[c].position, poses[c].angle, 0.0f);
+        featExact.insert(featExact.end(), a.begin() + 5, a.end());
+        featApprox.insert(featApprox.end(), b.begin() + 5, b.end());
+    }
+    std::cout << "  Observation error (18 LIDAR features):\n";
+    PrintErrorStats("features", featApprox, featExact);
+
+    std::remove(path.c_str());
+    return 0;
+}
+
+// Heap allocations per VecEnv step (and per GetState call) once buffers are warm.
+// Steady state must be allocation-free; returns 1 otherwise.
+static int BenchAllocations(const Image& trackImage) {
+    SurfaceGrid grid = BakeSurfaceGrid(trackImage);
+    std::vector<Checkpoint> checkpoints = TrackCheckpoints();
+    const int NUM_ENVS = 8;
+    const int WARMUP_STEPS = 1000;
+    const int MEASURE_STEPS = 20000;
+
+    std::cout << "=== Heap allocations per step (" << NUM_ENVS << " cars, "
+              << MEASURE_STEPS << " steps after " << WARMUP_STEPS << " warm-up) ===\n";
+
+    bool clean = true;
+    const LidarMode modes[] = { LidarMode::March, LidarMode::DistanceField, LidarMode::WallMask,
+                                LidarMode::DDA, LidarMode::Batch, LidarMode::Mip };
+    for (LidarMode mode : modes) {
+        LidarSensor lidar(grid, mode);
+        VecEnv env(grid, lidar, checkpoints, NUM_ENVS, 7500, 1.0f / 60.0f);
+        std::mt19937 gen(5);
+        std::uniform_int_distribution<int> pick(0, 6);
+        int actions[NUM_ENVS];
+
+        for (int s = 0; s < WARMUP_STEPS; s++) {
+            for (int& a : actions) a = pick(gen);
+            env.Step(actions);
+        }
+        long long before = g_heapAllocations.load();
+        for (int s = 0; s < MEASURE_STEPS; s++) {
+            for (int& a : actions) a = pick(gen);
+            env.Step(actions);
+        }
+        long long allocs = g_heapAllocations.load() - before;
+
+        std::cout << "  VecEnv::Step, " << std::left << std::setw(6) << LidarModeName(mode) << std::right
+                  << std::setw(10) << allocs << " allocations ("
+                  << std::setprecision(3) << (double)allocs / MEASURE_STEPS << " per step)\n";
+        clean = clean && allocs == 0;
+    }
+
+    Observation obs;
+    long long before = g_heapAllocations.load();
+    for (int s = 0; s < MEASURE_STEPS; s++) GetState(grid, {430.0f, 92.0f}, s * 0.001f, 100.0f, obs);
+    long long allocs = g_heapAllocations.load() - before;
+    std::cout << "  GetState(Observation&)" << std::setw(8) << allocs << " allocations\n";
+    clean = clean && allocs == 0;
+
+    std::cout << (clean ? "OK: steady-state stepping is allocation-free\n" : "FAIL: heap allocations in the step loop\n");
+    return clean ? 0 : 1;
+}
+
+// The replay buffer before the ring buffer: one Experience (two heap vectors) per transition,
+// erase(begin()) once full. Kept here as the baseline for the replay benchmark.
+struct LegacyExperience {
+    std::vector<float> state;
+    int action;
+    float reward;
+    std::vector<float> next_state;
+    bool done;
+
+    LegacyExperience(const std::vector<float>& s, int a, float r, const std::vector<float>& ns, bool d)
+        : state(s), action(a), reward(r), next_state(ns), done(d) {}
+};
+
+class LegacyReplayBuffer {
+public:
+    LegacyReplayBuffer(int capacity) : capacity_(capacity) { buffer_.reserve(capacity); }
+
+    void add(const std::vector<float>& state, int action, float reward,
+             const std::vector<float>& next_state, bool done) {
+        if ((int)buffer_.size() >= capacity_) buffer_.erase(buffer_.begin());
+        buffer_.emplace_back(state, action, reward, next_state, done);
+    }
+
+    void sample(int batch_size, std::vector<std::vector<float>>& states, std::vector<int>& actions,
+                std::vector<float>& rewards, std::vector<std::vector<float>>& next_states,
+                std::vector<bool>& dones) {
+        states.clear();
+        actions.clear();
+        rewards.clear();
+        next_states.clear();
+        dones.clear();
+
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<> dis(0, (int)buffer_.size() - 1);
+        for (int i = 0; i < batch_size; i++) {
+            const LegacyExperience& exp = buffer_[dis(gen)];
+            states.push_back(exp.state);
+            actions.push_back(exp.action);
+            rewards.push_back(exp.reward);
+            next_states.push_back(exp.next_state);
+            dones.push_back(exp.done);
+        }
+    }
+
+private:
+    int capacity_;
+    std::vector<LegacyExperience> buffer_;
+};
+
+// Runs op() in chunks of `chunk` until minSeconds elapsed; returns ns per call.
+template <class Fn>
+static double TimePerCall(Fn op, int chunk, double minSeconds = 0.5) {
+    long long calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        for (int i = 0; i < chunk; i++) op();
+        calls += chunk;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    return elapsed * 1e9 / calls;
+}
+
+// Steady-state insert and batch-32 sampling, ring buffer (pair and frame storage) vs the legacy
+// buffer, all full. Checks that ring-buffer insert and sample do not allocate and that frame
+// storage reconstructs the same transitions as pair storage; returns 1 otherwise.
+static int BenchReplay(const Image& trackImage, const std::vector<int>& capacities) {
+    const int STATE = OBSERVATION_SIZE;
+    const int BATCH = 32;
+    const int POOL = 4096;
+
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::vector<std::vector<float>> pool(POOL, std::vector<float>(STATE));
+    for (std::vector<float>& row : pool) for (float& v : row) v = value(gen);
+
+    std::cout << "=== Replay buffer, " << STATE << " floats per state, batch " << BATCH << " ===\n";
+    std::cout << std::left << std::setw(10) << "capacity" << std::setw(8) << "buffer" << std::right
+              << std::setw(12) << "fill s" << std::setw(14) << "insert ns" << std::setw(14) << "sample us"
+              << std::setw(12) << "MB" << "\n";
+
+    auto row = [](const std::string& cap, const std::string& name, double fill, double insertNs,
+                  double sampleNs, double mb) {
+        std::cout << std::left << std::setw(10) << cap << std::setw(8) << name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << fill << std::setw(14) << insertNs
+                  << std::setw(14) << sampleNs / 1000.0 << std::setw(12) << std::setprecision(0) << mb
+                  << "\n" << std::defaultfloat;
+    };
+
+    bool clean = true;
+    for (int capacity : capacities) {
+        const std::string cap = std::to_string(capacity);
+        int next = 0;
+
+        {
+            LegacyReplayBuffer legacy(capacity);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < capacity; i++) {
+                legacy.add(pool[i % POOL], i % 7, 1.0f, pool[(i + 1) % POOL], false);
+            }
+            double fill = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            double insertNs = TimePerCall([&]() {
+                legacy.add(pool[next % POOL], next % 7, 1.0f, pool[(next + 1) % POOL], false);
+                next++;
+            }, 1);
+
+            std::vector<std::vector<float>> states, nextStates;
+            std::vector<int> actions;
+            std::vector<float> rewards;
+            std::vector<bool> dones;
+            double sampleNs = TimePerCall([&]() {
+                legacy.sample(BATCH, states, actions, rewards, nextStates, dones);
+            }, 16);
+
+// One LegacyExperience plus two heap rows (malloc rounds 92 B up to 112 B with its header).
+            double mb = (double)capacity * (sizeof(LegacyExperience) + 2 * 112) / (1024.0 * 1024.0);
+            row(cap, "legacy", fill, insertNs, sampleNs, mb);
+        }
+
+        const ReplayStorage storages[] = { ReplayStorage::Pairs, ReplayStorage::Frames };
+        for (ReplayStorage storage : storages) {
+            const char* name = (storage == ReplayStorage::Pairs) ? "ring" : "frames";
+            ReplayBuffer ring(capacity, STATE, storage);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < capacity; i++) {
+                ring.add(pool[i % POOL].data(), i % 7, 1.0f, pool[(i + 1) % POOL].data(), false);
+            }
+            double fill = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            ReplayBatch batch;
+            ring.sample(BATCH, batch);
+
+            long long allocsBefore = g_heapAllocations.load();
+            double insertNs = TimePerCall([&]() {
+                ring.add(pool[next % POOL].data(), next % 7, 1.0f, pool[(next + 1) % POOL].data(), false);
+                next++;
+            }, 1024);
+            double sampleNs = TimePerCall([&]() { ring.sample(BATCH, batch); }, 64);
+            long long allocs = g_heapAllocations.load() - allocsBefore;
+
+            row(cap, name, fill, insertNs, sampleNs, ring.Bytes() / (1024.0 * 1024.0));
+            if (allocs != 0) {
+                std::cout << "  " << name << " allocated " << allocs << " times in steady state\n";
+                clean = false;
+            }
+        }
+    }
+
+// Frame storage against pair storage on real multi-car episodes (resets, interleaved cars):
+// every stored transition must reconstruct the same rows.
+    {
+        const int CAPACITY = 100000;
+        const int NUM_ENVS = 8;
+        SurfaceGrid grid = BakeSurfaceGrid(trackImage);
+        LidarSensor lidar(grid, LidarMode::Batch);
+        VecEnv env(grid, lidar, TrackCheckpoints(), NUM_ENVS, 600, 1.0f / 60.0f);
+        ReplayBuffer pairs(CAPACITY, STATE, ReplayStorage::Pairs);
+        ReplayBuffer frames(CAPACITY, STATE, ReplayStorage::Frames);
+
+        std::uniform_int_distribution<int> pick(0, 6);
+        int actions[NUM_ENVS];
+        int episodes = 0;
+        for (int step = 0; step < (3 * CAPACITY) / NUM_ENVS; step++) {
+            for (int& a : actions) a = pick(gen);
+            env.Step(actions);
+            for (int i = 0; i < NUM_ENVS; i++) {
+                const VecEnv::StepResult& result = env.Result(i);
+                pairs.add(env.PrevObservation(i), actions[i], result.reward, env.NextObservation(i), result.done);
+                frames.add(env.PrevObservation(i), actions[i], result.reward, env.NextObservation(i), result.done, i);
+                if (result.episodeOver) episodes++;
+            }
+        }
+
+        long long mismatches = 0;
+        const size_t rowBytes = pairs.row_bytes();
+        for (int k = 0; k < frames.size(); k++) {
+            int slot = (CAPACITY - frames.size() + k) % CAPACITY; // the buffer is full: cursor is 0 here.
+            if (std::memcmp(pairs.StateRow(slot), frames.StateRow(slot), rowBytes) != 0 ||
+                std::memcmp(pairs.NextStateRow(slot), frames.NextStateRow(slot), rowBytes) != 0) {
+                mismatches++;
+            }
+        }
+        std::cout << "Frames vs pairs on " << NUM_ENVS << " cars, " << episodes << " episodes: "
+                  << frames.size() << " / " << pairs.size() << " transitions kept, "
+                  << std::setprecision(3) << (double)pairs.Bytes() / frames.Bytes() << "x less memory, "
+                  << mismatches << " mismatched rows\n";
+        if (mismatches != 0 || frames.size() < CAPACITY * 9 / 10) clean = false;
+    }
+
+    std::cout << (clean ? "OK: ring-buffer insert and sample are allocation-free, frames match pairs\n"
+                        : "FAIL: ring-buffer allocations or frame mismatch\n");
+    return clean ? 0 : 1;
+}
+
+// Prioritized replay: sum-tree correctness (batched vs single updates, sampled frequencies vs
+// priorities), then batch-32 sample and priority-update cost against uniform sampling.
+static int BenchPrioritized(const std::vector<int>& capacities) {
+    const int STATE = OBSERVATION_SIZE;
+    const int BATCH = 32;
+    bool ok = true;
+    std::mt19937 gen(13);
+
+    {
+        const int N = 1000;
+        std::uniform_real_distribution<double> value(0.0, 10.0);
+        SumTree single(N), batched(N);
+        std::vector<int> idx(BATCH);
+        std::vector<double> val(BATCH);
+        std::uniform_int_distribution<int> leaf(0, N - 1);
+        for (int round = 0; round < 2000; round++) {
+            for (int k = 0; k < BATCH; k++) {
+                idx[k] = leaf(gen);
+                val[k] = (round % 7 == 0) ? 0.0 : value(gen);
+                single.Set(idx[k], val[k]);
+            }
+            batched.SetBatch(idx.data(), val.data(), BATCH);
+        }
+        int findDiffs = 0;
+        std::uniform_real_distribution<double> frac(0.0, 1.0);
+        for (int k = 0; k < 100000; k++) {
+            double mass = frac(gen) * single.Total();
+            if (single.Find(mass) != batched.Find(mass)) findDiffs++;
+        }
+        double sumDiff = std::fabs(single.Total() - batched.Total());
+
+// Empirical sampling frequencies through the replay buffer against p_i / sum(p).
+        ReplayBuffer buffer(N, STATE);
+        buffer.enable_prioritized(1.0f, 0.0f);
+        std::vector<float> row(STATE, 0.0f);
+        for (int i = 0; i < N; i++) buffer.add(row.data(), 0, 0.0f, row.data(), false);
+        std::vector<int> slots(N);
+        std::vector<float> errors(N);
+        for (int i = 0; i < N; i++) {
+            slots[i] = i;
+            errors[i] = (i % 10 == 0) ? 0.0f : (float)(1 + i % 17);
+        }
+        buffer.update_priorities(slots.data(), errors.data(), N);
+        double total = 0.0;
+        for (float e : errors) total += e;
+
+        std::vector<long long> counts(N, 0);
+        ReplayBatch batch;
+        const int DRAWS = 20000;
+        for (int d = 0; d < DRAWS; d++) {
+            buffer.sample(BATCH, batch, 0.5f);
+            for (int k = 0; k < BATCH; k++) counts[batch.indices[k]]++;
+        }
+        double tv = 0.0;
+        long long zeroHits = 0;
+        for (int i = 0; i < N; i++) {
+            tv += std::fabs((double)counts[i] / ((double)DRAWS * BATCH) - errors[i] / total);
+            if (errors[i] == 0.0f) zeroHits += counts[i];
+        }
+        tv *= 0.5;
+
+        std::cout << "=== Prioritized replay ===\n";
+        std::cout << "SumTree batched vs single updates: total diff " << sumDiff << ", "
+                  << findDiffs << " / 100000 Find mismatches\n";
+        std::cout << "Sampling vs priorities: total variation " << std::setprecision(4) << tv
+                  << ", zero-priority draws " << zeroHits << "\n" << std::defaultfloat;
+        ok = ok && findDiffs == 0 && sumDiff < 1e-6 && tv < 0.03 && zeroHits == 0;
+    }
+
+// Late priority updates (prefetched / async batches): adds between sample and update overwrite
+// slots (pairs) or evict them with their frames (frames, small frame ring). The update must
+// only land on slots still holding the sampled transitions; evicted slots stay at 0.
+    {
+        const int CAPACITY = 64;
+        const float LATE_ERROR = 1000.0f;
+        std::vector<float> row(STATE), next(STATE);
+        std::vector<float> errors(BATCH, LATE_ERROR);
+        auto fill = [&](float v) {
+            std::fill(row.begin(), row.end(), v);
+            std::fill(next.begin(), next.end(), v + 1.0f);
+        };
+        long long stale = 0, evictedSampled = 0, overwrittenSampled = 0;
+        for (ReplayStorage storage : {ReplayStorage::Pairs, ReplayStorage::Frames}) {
+            const bool frames = storage == ReplayStorage::Frames;
+            ReplayBuffer buffer(CAPACITY, STATE, storage, frames ? CAPACITY + 8 : 0);
+            buffer.enable_prioritized(0.6f);
+            for (int i = 0; i < CAPACITY; i++) {
+                fill((float)i);
+                buffer.add(row.data(), 0, 0.0f, next.data(), false);
+            }
+            ReplayBatch batch;
+            buffer.sample(BATCH, batch, 0.4f);
+            const int64_t generation = buffer.added();
+
+// Pairs: 24 adds overwrite slots 0..23. Frames: episode starts on fresh streams write two
+// frames each, evicting the oldest transitions.
+            const int ADDS = 24;
+            for (int i = 0; i < ADDS; i++) {
+                fill(1000.0f + 2 * i);
+                buffer.add(row.data(), 0, 0.0f, next.data(), false, frames ? 1 + i : 0);
+            }
+            std::vector<char> rewritten(CAPACITY, 0);
+            for (int k = 0; k < BATCH; k++) {
+                const int slot = batch.indices[k];
+                if (slot < ADDS) {
+                    overwrittenSampled++;
+                    rewritten[slot] = 1;
+                } else if (!buffer.stored(slot)) {
+                    evictedSampled++;
+                }
+            }
+            std::vector<double> expected(CAPACITY);
+            for (int slot = 0; slot < CAPACITY; slot++) expected[slot] = buffer.priority(slot);
+
+            buffer.update_priorities(batch.indices.data(), errors.data(), BATCH, generation);
+            const double late = std::pow((double)LATE_ERROR + 1e-6f, (double)0.6f); // as the buffer rounds them.
+            for (int slot = 0; slot < CAPACITY; slot++) {
+                const double p = buffer.priority(slot);
+                if (!buffer.stored(slot) && p != 0.0) stale++;
+                if (rewritten[slot] && p != expected[slot]) stale++;
+                bool sampled = false;
+                for (int k = 0; k < BATCH; k++) sampled = sampled || batch.indices[k] == slot;
+                if (sampled && buffer.stored(slot) && !rewritten[slot] && std::fabs(p - late) > 1e-12 * late) stale++;
+                if (!sampled && p != expected[slot]) stale++;
+            }
+        }
+        std::cout << "Late priority updates: " << overwrittenSampled << " sampled slots overwritten, "
+                  << evictedSampled << " evicted before the update, " << stale << " wrong priorities\n";
+        ok = ok && stale == 0 && overwrittenSampled > 0 && evictedSampled > 0;
+    }
+
+    std::cout << std::left << std::setw(10) << "capacity" << std::right << std::setw(16) << "uniform us"
+              << std::setw(16) << "prioritized us" << std::setw(14) << "update us" << std::setw(16)
+              << "update 1x1 us" << std::setw(10) << "tree MB" << "\n";
+    for (int capacity : capacities) {
+        std::vector<float> row(STATE, 0.5f);
+        ReplayBuffer uniform(capacity, STATE);
+        ReplayBuffer prioritized(capacity, STATE);
+        prioritized.enable_prioritized(0.6f);
+        for (int i = 0; i < capacity; i++) {
+            uniform.add(row.data(), i % 7, 1.0f, row.data(), false);
+            prioritized.add(row.data(), i % 7, 1.0f, row.data(), false);
+        }
+
+        ReplayBatch batch;
+        std::vector<float> td(BATCH);
+        std::uniform_real_distribution<float> error(0.0f, 5.0f);
+        uniform.sample(BATCH, batch);
+        prioritized.sample(BATCH, batch, 0.4f);
+        for (float& e : td) e = error(gen);
+        prioritized.update_priorities(batch.indices.data(), td.data(), BATCH);
+
+        long long allocsBefore = g_heapAllocations.load();
+        double uniformNs = TimePerCall([&]() { uniform.sample(BATCH, batch); }, 64);
+        double sampleNs = TimePerCall([&]() { prioritized.sample(BATCH, batch, 0.4f); }, 64);
+        double updateNs = TimePerCall([&]() {
+            prioritized.update_priorities(batch.indices.data(), td.data(), BATCH);
+        }, 64);
+        double singleNs = TimePerCall([&]() {
+            for (int k = 0; k < BATCH; k++) prioritized.update_priorities(&batch.indices[k], &td[k], 1);
+        }, 64);
+        long long allocs = g_heapAllocations.load() - allocsBefore;
+
+        std::cout << std::left << std::setw(10) << capacity << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(16) << uniformNs / 1000.0 << std::setw(16) << sampleNs / 1000.0
+                  << std::setw(14) << updateNs / 1000.0 << std::setw(16) << singleNs / 1000.0
+                  << std::setw(10) << std::setprecision(0)
+                  << (prioritized.Bytes() - uniform.Bytes()) / (1024.0 * 1024.0) << "\n" << std::defaultfloat;
+        if (allocs != 0) {
+            std::cout << "  prioritized sample/update allocated " << allocs << " times\n";
+            ok = false;
+        }
+    }
+
+    std::cout << (ok ? "OK: sum tree consistent, sampling proportional, no allocations\n"
+                     : "FAIL: prioritized replay check\n");
+    return ok ? 0 : 1;
+}
+
+// Full train step (sample + update) through the three batch paths, at each batch size:
+// legacy vectors (vector<vector<float>> sample, flatten, clone), flat arrays (ReplayBatch,
+// from_blob + clone) and the learner's persistent tensors (sampled in place, no copies).
+// "overhead" is the step time minus the update alone on an already-filled TrainBatch.
+// The prefetch rows sample on a BatchPrefetcher worker and report its stall metrics.
+static int BenchLearner(const std::vector<int>& batchSizes) {
+    const int STATE = OBSERVATION_SIZE;
+    const int CAPACITY = 50000;
+
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> pickAction(0, ACTION_COUNT - 1);
+    LegacyReplayBuffer legacy(CAPACITY);
+    ReplayBuffer ring(CAPACITY, STATE);
+    std::vector<float> state(STATE), next(STATE);
+    for (int i = 0; i < CAPACITY; i++) {
+        for (int k = 0; k < STATE; k++) {
+            state[k] = value(gen);
+            next[k] = value(gen);
+        }
+        int action = pickAction(gen);
+        float reward = value(gen);
+        bool done = (i % 500) == 499;
+        legacy.add(state, action, reward, next, done);
+        ring.add(state.data(), action, reward, next.data(), done);
+    }
+
+    DQN dqn(STATE, ACTION_COUNT);
+    std::cout << "=== Learner train step (sample + update), " << torch::get_num_threads() << " threads ===\n";
+    std::cout << std::left << std::setw(8) << "batch" << std::setw(10) << "path" << std::right
+              << std::setw(14) << "step us" << std::setw(14) << "overhead us" << "\n";
+
+    for (int batchSize : batchSizes) {
+        DQN::TrainBatch& tensors = dqn.train_batch(batchSize);
+        ring.sample(tensors.view());
+        double computeNs = TimePerCall([&]() { dqn.train(tensors, false); }, 8, 1.0);
+
+        std::vector<std::vector<float>> states, nextStates;
+        std::vector<int> actions;
+        std::vector<float> rewards;
+        std::vector<bool> dones;
+        double vectorNs = TimePerCall([&]() {
+            legacy.sample(batchSize, states, actions, rewards, nextStates, dones);
+            dqn.train(states, actions, rewards, nextStates, dones, batchSize);
+        }, 8, 1.0);
+
+        ReplayBatch flat;
+        double flatNs = TimePerCall([&]() {
+            ring.sample(batchSize, flat);
+            dqn.train(flat.states.data(), flat.actions.data(), flat.rewards.data(),
+                      flat.next_states.data(), flat.dones.data(), batchSize);
+        }, 8, 1.0);
+
+        double tensorNs = TimePerCall([&]() {
+            ring.sample(tensors.view());
+            dqn.train(tensors, false);
+        }, 8, 1.0);
+
+        auto row = [&](const char* name, double ns) {
+            std::cout << std::left << std::setw(8) << batchSize << std::setw(10) << name << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(14) << ns / 1000.0
+                      << std::setw(14) << (ns - computeNs) / 1000.0 << "\n" << std::defaultfloat;
+        };
+        row("vectors", vectorNs);
+        row("flat", flatNs);
+        row("tensors", tensorNs);
+
+// Sampling moved to the prefetch worker: only the update (plus handoff) stays on this thread.
+        for (int depth : {1, 4}) {
+            BatchPrefetcher prefetcher(ring, batchSize, STATE, depth);
+            prefetcher.Start();
+            double prefetchNs = TimePerCall([&]() {
+                DQN::TrainBatch& ready = prefetcher.Acquire();
+                dqn.train(ready, false);
+                prefetcher.Release();
+            }, 8, 1.0);
+            BatchPrefetcher::Stats ps = prefetcher.stats();
+            prefetcher.Stop();
+            row(depth == 1 ? "prefetch1" : "prefetch4", prefetchNs);
+            std::cout << "          learner stalls " << ps.stalls << "/" << ps.batches << " ("
+                      << std::fixed << std::setprecision(3) << ps.stallSeconds << " s), worker sample "
+                      << ps.sampleSeconds << " s, idle " << ps.idleSeconds << " s\n" << std::defaultfloat;
+        }
+        std::cout << std::left << std::setw(8) << batchSize << std::setw(10) << "update" << std::right
+                  << std::fixed << std::setprecision(1) << std::setw(14) << computeNs / 1000.0 << "\n"
+                  << std::defaultfloat;
+    }
+    return 0;
+}
+
+// Generator throughput (epsilon-greedy style draws) and seeding: equal seeds must replay the
+// same batches, different streams of one seed must not.
+static int BenchRng() {
+    const int DRAWS = 1 << 24;
+    bool ok = true;
+    std::cout << "=== PRNG ===\n";
+
+    auto time = [&](const char* name, auto draw) {
+        uint64_t sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < DRAWS; i++) sink += draw();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(8) << seconds * 1e9 / DRAWS << " ns/draw" << std::defaultfloat
+                  << (sink == 42 ? " " : "") << "\n";
+    };
+    std::srand(1);
+    time("rand() % 7", []() { return (uint64_t)(std::rand() % 7); });
+    std::mt19937 mt(1);
+    std::uniform_int_distribution<int> dist(0, 6);
+    time("mt19937 + uniform_int", [&]() { return (uint64_t)dist(mt); });
+    Rng rng(1);
+    time("Rng::NextInt(7)", [&]() { return (uint64_t)rng.NextInt(7); });
+    time("Rng::NextFloat() < eps", [&]() { return (uint64_t)(rng.NextFloat() < 0.1f); });
+
+    const int STATE = OBSERVATION_SIZE;
+    std::vector<float> row(STATE, 0.0f);
+    auto batches = [&](uint64_t seed, uint64_t stream, bool prioritized) {
+        ReplayBuffer buffer(4096, STATE);
+        buffer.seed(seed, stream);
+        if (prioritized) buffer.enable_prioritized(0.6f);
+        for (int i = 0; i < 4096; i++) buffer.add(row.data(), 0, 0.0f, row.data(), false);
+        std::vector<int> drawn;
+        ReplayBatch batch;
+        std::vector<float> td(32);
+        for (int b = 0; b < 100; b++) {
+            buffer.sample(32, batch, 0.4f);
+            drawn.insert(drawn.end(), batch.indices.begin(), batch.indices.end());
+            for (int k = 0; k < 32; k++) td[k] = (float)((batch.indices[k] * 7919) % 100) * 0.01f;
+            buffer.update_priorities(batch.indices.data(), td.data(), 32);
+        }
+        return drawn;
+    };
+    for (bool prioritized : {false, true}) {
+        bool same = batches(7, RNG_STREAM_REPLAY, prioritized) == batches(7, RNG_STREAM_REPLAY, prioritized);
+        bool streamsDiffer = batches(7, RNG_STREAM_REPLAY, prioritized) != batches(7, RNG_STREAM_PREFETCH, prioritized);
+        bool seedsDiffer = batches(7, RNG_STREAM_REPLAY, prioritized) != batches(8, RNG_STREAM_REPLAY, prioritized);
+        std::cout << "  " << (prioritized ? "prioritized" : "uniform    ") << " sampling: same seed "
+                  << (same ? "identical" : "DIFFERENT") << ", other stream " << (streamsDiffer ? "differs" : "IDENTICAL")
+                  << ", other seed " << (seedsDiffer ? "differs" : "IDENTICAL") << "\n";
+        ok = ok && same && streamsDiffer && seedsDiffer;
+    }
+
+    std::cout << (ok ? "OK: seeded sampling is reproducible, streams are independent\n"
+                     : "FAIL: seeding check\n");
+    return ok ? 0 : 1;
+}
+
+// Transition content derived from (producer, count), so a reader can tell a torn row apart.
+static void FillTransition(int producer, int count, int stateSize, float* state, float* nextState) {
+    state[0] = (float)producer;
+    state[1] = (float)count;
+    for (int k = 2; k < stateSize; k++) state[k] = (float)((producer * 31 + count * 7 + k) % 4096);
+    for (int k = 0; k < stateSize; k++) nextState[k] = state[k] + 1.0f;
+}
+
+static bool TransitionIntact(const float* state, const float* nextState, int64_t action, float reward,
+                             float done, int stateSize) {
+    const int producer = (int)state[0];
+    const int count = (int)state[1];
+    for (int k = 2; k < stateSize; k++) {
+        if (state[k] != (float)((producer * 31 + count * 7 + k) % 4096)) return false;
+    }
+    for (int k = 0; k < stateSize; k++) {
+        if (nextState[k] != state[k] + 1.0f) return false;
+    }
+    return action == (producer + count) % 7 && reward == (float)count && done == (count % 5 == 0 ? 1.0f : 0.0f);
+}
+
+// Lock-free multi-producer replay. Stress: producers hammer a small ring (constant lapping)
+// while a learner samples and checks every row for tearing; afterwards each slot must hold
+// its last published transition. Throughput: producers 1..32 adding into a large ring with a
+// learner sampling alongside, against ReplayBuffer behind one mutex.
+static int BenchConcurrentReplay(const std::vector<int>& producerCounts) {
+    const int STATE = OBSERVATION_SIZE;
+    const int BATCH = 32;
+    bool ok = true;
+    std::cout << "=== Multi-producer replay (" << std::thread::hardware_concurrency() << " hardware threads) ===\n";
+
+    for (int producers : {2, 8, 32}) {
+        const int CAPACITY = 1024;
+        const int PER_PRODUCER = 200000 / producers;
+        ConcurrentReplayBuffer buffer(CAPACITY, STATE);
+        std::atomic<int> running{producers};
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; p++) {
+            threads.emplace_back([&, p]() {
+                std::vector<float> state(STATE), nextState(STATE);
+                for (int c = 0; c < PER_PRODUCER; c++) {
+                    FillTransition(p, c, STATE, state.data(), nextState.data());
+                    buffer.add(state.data(), (p + c) % 7, (float)c, nextState.data(), c % 5 == 0);
+                }
+                running--;
+            });
+        }
+
+        long long rows = 0, torn = 0, rejected = 0;
+        Rng rng(17);
+        ReplayBatch batch;
+        while (running > 0) {
+            if (!buffer.can_sample(BATCH)) {
+                std::this_thread::yield();
+                continue;
+            }
+            rejected += buffer.sample(BATCH, batch, rng);
+            for (int i = 0; i < BATCH; i++) {
+                const size_t row = (size_t)i * STATE;
+                if (!TransitionIntact(&batch.states[row], &batch.next_states[row], batch.actions[i],
+                                      batch.rewards[i], batch.dones[i], STATE)) torn++;
+            }
+            rows += BATCH;
+        }
+        for (std::thread& t : threads) t.join();
+
+// Quiescent: sweep every slot (random batches until all were seen); each must hold an intact
+// transition, and each producer's surviving rows must be a contiguous run ending at its last add.
+        long long badSlots = 0;
+        std::vector<int> newest(producers, -1), oldest(producers, PER_PRODUCER);
+        std::vector<int> perProducer(producers, 0);
+        {
+            ReplayBatch one;
+            Rng sweep(3);
+            std::vector<char> seen(CAPACITY, 0);
+            int distinct = 0;
+            for (int round = 0; round < 64 && distinct < CAPACITY; round++) {
+                buffer.sample(CAPACITY, one, sweep);
+                for (int i = 0; i < CAPACITY; i++) {
+                    const size_t row = (size_t)i * STATE;
+                    const int slot = one.indices[i];
+                    if (!TransitionIntact(&one.states[row], &one.next_states[row], one.actions[i],
+                                          one.rewards[i], one.dones[i], STATE)) badSlots++;
+                    if (seen[slot]) continue;
+                    seen[slot] = 1;
+                    distinct++;
+                    const int p = (int)one.states[row];
+                    const int c = (int)one.states[row + 1];
+                    perProducer[p]++;
+                    newest[p] = std::max(newest[p], c);
+                    oldest[p] = std::min(oldest[p], c);
+                }
+            }
+            if (distinct < CAPACITY) badSlots += CAPACITY - distinct;
+        }
+        for (int p = 0; p < producers; p++) {
+            if (perProducer[p] == 0) continue;
+            if (newest[p] != PER_PRODUCER - 1 || newest[p] - oldest[p] + 1 != perProducer[p]) badSlots++;
+        }
+
+        std::cout << "  stress " << std::setw(2) << producers << " producers: " << buffer.added()
+                  << " adds into " << CAPACITY << " slots, " << rows << " rows sampled, " << torn
+                  << " torn, " << rejected << " slot reads rejected, " << badSlots << " bad slots at rest\n";
+        ok = ok && torn == 0 && badSlots == 0 && buffer.added() == (int64_t)producers * PER_PRODUCER;
+    }
+
+// Sampling before enough slots are reserved must return at once instead of spinning.
+    {
+        ConcurrentReplayBuffer empty(64, STATE);
+        ReplayBatch batch;
+        Rng rng(5);
+        const bool refusedEmpty = empty.sample(BATCH, batch, rng) < 0;
+        std::vector<float> state(STATE), nextState(STATE);
+        FillTransition(0, 0, STATE, state.data(), nextState.data());
+        empty.add(state.data(), 0, 0.0f, nextState.data(), false);
+        const bool refusedShort = empty.sample(BATCH, batch, rng) < 0;
+        const bool sampledOne = empty.sample(1, batch, rng) == 0;
+        std::cout << "  empty buffer: " << (refusedEmpty ? "refused" : "SAMPLED") << ", 1 of " << BATCH
+                  << " rows: " << (refusedShort ? "refused" : "SAMPLED") << ", batch of 1: "
+                  << (sampledOne ? "ok" : "FAILED") << "\n";
+        ok = ok && refusedEmpty && refusedShort && sampledOne;
+    }
+
+    std::cout << "  " << std::left << std::setw(11) << "producers" << std::right << std::setw(16)
+              << "lock-free M/s" << std::setw(14) << "mutex M/s" << std::setw(20) << "learner kbatch/s lf"
+              << std::setw(20) << "kbatch/s mutex" << "\n";
+    const int CAPACITY = 1000000;
+    const int TOTAL = 2000000;
+    auto run = [&](int producers, auto add, auto sample) {
+        std::atomic<int> running{producers};
+        std::atomic<bool> go{false};
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; p++) {
+            threads.emplace_back([&, p]() {
+                std::vector<float> state(STATE), nextState(STATE);
+                FillTransition(p, 0, STATE, state.data(), nextState.data());
+                while (!go) std::this_thread::yield();
+                for (int c = p; c < TOTAL; c += producers) add(state.data(), c % 7, (float)c, nextState.data(), false);
+                running--;
+            });
+        }
+        long long batches = 0;
+        auto start = std::chrono::steady_clock::now();
+        go = true;
+        while (running > 0) {
+            if (sample()) batches++;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (std::thread& t : threads) t.join();
+        return std::make_pair(TOTAL / seconds * 1e-6, batches / seconds * 1e-3);
+    };
+
+    for (int producers : producerCounts) {
+        ConcurrentReplayBuffer lockFree(CAPACITY, STATE);
+        Rng rng(19);
+        ReplayBatch batch;
+        auto lf = run(producers,
+            [&](const float* s, int a, float r, const float* ns, bool d) { lockFree.add(s, a, r, ns, d); },
+            [&]() {
+                if (!lockFree.can_sample(BATCH)) return false;
+                lockFree.sample(BATCH, batch, rng);
+                return true;
+            });
+
+        ReplayBuffer locked(CAPACITY, STATE);
+        std::mutex mutex;
+        auto mx = run(producers,
+            [&](const float* s, int a, float r, const float* ns, bool d) {
+                std::lock_guard<std::mutex> lock(mutex);
+                locked.add(s, a, r, ns, d);
+            },
+            [&]() {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!locked.can_sample(BATCH)) return false;
+                locked.sample(BATCH, batch);
+                return true;
+            });
+
+        std::cout << "  " << std::left << std::setw(11) << producers << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(16) << lf.first << std::setw(14) << mx.first
+                  << std::setprecision(1) << std::setw(20) << lf.second << std::setw(20) << mx.second
+                  << std::defaultfloat << "\n";
+    }
+
+    std::cout << (ok ? "OK: no torn rows, every slot holds its last published transition\n"
+                     : "FAIL: concurrent replay check\n");
+    return ok ? 0 : 1;
+}
+
+// Memory-mapped replay. Small ring: the mapped records reproduce pair storage exactly (same
+// seed, same batches) through wrap-around and a reopen. Large ring: create a sparse file of
+// `capacity` records, fill `fill` of them, then time insert, sampling, reopen and the first
+// batch after reopening. The file is written to the working directory and removed afterwards.
+static int BenchMappedReplay(int capacity, int fill) {
+    const int STATE = OBSERVATION_SIZE;
+    const int BATCH = 32;
+    const char* PATH = "replay_bench.bin";
+    bool ok = true;
+    std::mt19937 gen(23);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::cout << "=== Memory-mapped replay ===\n";
+
+    const int POOL = 4096;
+    std::vector<float> pool((size_t)POOL * STATE);
+    for (float& v : pool) v = value(gen);
+    auto addFrom = [&](ReplayBuffer& buffer, long long k) {
+        const int row = (int)(k % POOL);
+        buffer.add(&pool[(size_t)row * STATE], (int)(k % 7), (float)(k % 100), &pool[(size_t)((row + 1) % POOL) * STATE],
+                   k % 50 == 0);
+    };
+    auto sameBatches = [&](ReplayBuffer& a, ReplayBuffer& b) {
+        ReplayBatch x, y;
+        a.seed(5);
+        b.seed(5);
+        for (int round = 0; round < 100; round++) {
+            a.sample(BATCH, x);
+            b.sample(BATCH, y);
+            if (x.indices != y.indices || x.states != y.states || x.next_states != y.next_states ||
+                x.actions != y.actions || x.rewards != y.rewards || x.dones != y.dones) return false;
+        }
+        return true;
+    };
+
+    {
+        const int SMALL = 10000;
+        std::remove(PATH);
+        ReplayBuffer pairs(SMALL, STATE);
+        bool same = false, resumed = false, rejected = false;
+        {
+            ReplayBuffer mapped(SMALL, STATE, ReplayStorage::Mapped);
+            if (mapped.open_mapped(PATH)) {
+                for (long long k = 0; k < 25000; k++) {
+                    addFrom(pairs, k);
+                    addFrom(mapped, k);
+                }
+                same = sameBatches(pairs, mapped);
+            }
+        }
+        {
+            ReplayBuffer reopened(SMALL, STATE, ReplayStorage::Mapped);
+            if (reopened.open_mapped(PATH)) {
+                for (long long k = 25000; k < 27000; k++) {
+                    addFrom(pairs, k);
+                    addFrom(reopened, k);
+                }
+                resumed = sameBatches(pairs, reopened);
+            }
+            ReplayBuffer wrongCapacity(SMALL * 2, STATE, ReplayStorage::Mapped);
+            rejected = !wrongCapacity.open_mapped(PATH);
+        }
+        std::cout << "  pairs vs mapped (" << SMALL << " slots, wrapped): "
+                  << (same ? "identical" : "DIFFERENT") << ", after reopen + 2000 adds: "
+                  << (resumed ? "identical" : "DIFFERENT") << ", other capacity: "
+                  << (rejected ? "refused" : "OPENED") << "\n";
+        ok = ok && same && resumed && rejected;
+        std::remove(PATH);
+
+// Prioritized reopen of a file left mid-overwrite (size capacity - 1, cursor mid-ring): the
+// resumed window wraps, and the slot being overwritten must never be drawn.
+        const int RING = 64;
+        bool windowOk = false;
+        long long cursorHits = 0, newestHits = 0;
+        {
+            ReplayBuffer mapped(RING, STATE, ReplayStorage::Mapped);
+            if (mapped.open_mapped(PATH)) {
+                for (long long k = 0; k < RING + 36; k++) addFrom(mapped, k);
+            }
+        }
+        {
+            MappedFile raw;
+            if (raw.OpenReadWrite(PATH)) {
+                ReplayFileHeader* header = (ReplayFileHeader*)raw.data();
+                windowOk = header->cursor == 36 && header->size == RING;
+                header->size = RING - 1;
+            }
+        }
+        {
+            ReplayBuffer reopened(RING, STATE, ReplayStorage::Mapped);
+            reopened.enable_prioritized(0.6f);
+            windowOk = windowOk && reopened.open_mapped(PATH) && reopened.size() == RING - 1;
+            ReplayBatch batch;
+            for (int round = 0; windowOk && round < 2000; round++) {
+                reopened.sample(BATCH, batch, 0.4f);
+                for (int i = 0; i < BATCH; i++) {
+                    if (batch.indices[i] == 36) cursorHits++;
+                    if (batch.indices[i] == 35) newestHits++;
+                }
+            }
+        }
+        std::cout << "  prioritized reopen mid-overwrite (" << RING << " slots, cursor 36): slot 36 drawn "
+                  << cursorHits << " times, newest slot " << newestHits << " times\n";
+        ok = ok && windowOk && cursorHits == 0 && newestHits > 0;
+        std::remove(PATH);
+
+// Encoded records: u8 mapped against u8 pairs, and a u8 file refuses to open as fp32.
+        float lo[OBSERVATION_SIZE], hi[OBSERVATION_SIZE];
+        ObservationBounds(lo, hi);
+        for (float& v : pool) v = 0.5f + 0.5f * v;
+        ObservationCodec u8(ObservationEncoding::Uint8, STATE, lo, hi);
+        ReplayBuffer pairsU8(SMALL, STATE);
+        pairsU8.set_observation_codec(u8);
+        bool sameU8 = false, rejectedU8 = false;
+        {
+            ReplayBuffer mapped(SMALL, STATE, ReplayStorage::Mapped);
+            mapped.set_observation_codec(u8);
+            if (mapped.open_mapped(PATH)) {
+                for (long long k = 0; k < 15000; k++) {
+                    addFrom(pairsU8, k);
+                    addFrom(mapped, k);
+                }
+                sameU8 = sameBatches(pairsU8, mapped);
+            }
+            ReplayBuffer fp32(SMALL, STATE, ReplayStorage::Mapped);
+            rejectedU8 = !fp32.open_mapped(PATH);
+        }
+        std::cout << "  u8 pairs vs u8 mapped: " << (sameU8 ? "identical" : "DIFFERENT")
+                  << ", u8 file as fp32: " << (rejectedU8 ? "refused" : "OPENED") << "\n";
+        ok = ok && sameU8 && rejectedU8;
+        std::remove(PATH);
+    }
+
+    auto seconds = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    const double fileGB = (MAPPED_HEADER_BYTES + (double)capacity * (2 * STATE + 3) * sizeof(float)) / 1e9;
+    ReplayBatch batch;
+    std::vector<int> before;
+    {
+        auto start = std::chrono::steady_clock::now();
+        ReplayBuffer mapped(capacity, STATE, ReplayStorage::Mapped);
+        if (!mapped.open_mapped(PATH)) {
+            std::cout << "  cannot create " << PATH << " (" << fileGB << " GB)\n";
+            return 1;
+        }
+        double createSeconds = seconds(start);
+
+        start = std::chrono::steady_clock::now();
+        for (long long k = 0; k < fill; k++) addFrom(mapped, k);
+        double addSeconds = seconds(start);
+        double sampleNs = TimePerCall([&]() { mapped.sample(BATCH, batch); }, 256);
+        start = std::chrono::steady_clock::now();
+        mapped.flush();
+        double flushSeconds = seconds(start);
+
+        mapped.seed(9);
+        mapped.sample(BATCH, batch);
+        before = batch.indices;
+        std::cout << "  " << capacity << " slots (" << std::fixed << std::setprecision(1) << fileGB
+                  << " GB sparse file): create " << std::setprecision(3) << createSeconds * 1e3 << " ms, "
+                  << fill << " adds at " << std::setprecision(1) << addSeconds * 1e9 / fill << " ns, batch-"
+                  << BATCH << " sample " << sampleNs << " ns, flush " << std::setprecision(3) << flushSeconds
+                  << " s\n" << std::defaultfloat;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ReplayBuffer reopened(capacity, STATE, ReplayStorage::Mapped);
+    bool opened = reopened.open_mapped(PATH);
+    double openSeconds = seconds(start);
+    bool resumed = opened && reopened.size() == std::min(capacity, fill);
+    if (resumed) {
+        reopened.seed(9);
+        reopened.sample(BATCH, batch);
+        resumed = batch.indices == before;
+    }
+    double firstBatchSeconds = seconds(start);
+    std::cout << "  reopen: " << std::fixed << std::setprecision(3) << openSeconds * 1e3 << " ms, first batch after "
+              << firstBatchSeconds * 1e3 << " ms, " << reopened.size() << " transitions resumed ("
+              << (resumed ? "same batch" : "MISMATCH") << ")\n" << std::defaultfloat;
+    ok = ok && resumed;
+    std::remove(PATH);
+
+    std::cout << (ok ? "OK: mapped replay matches pair storage and resumes after reopening\n"
+                     : "FAIL: mapped replay check\n");
+    return ok ? 0 : 1;
+}
+
+// Quantized observation storage on real 8-car episodes: memory per encoding (pair and frame
+// storage), decode error per feature group against fp32, and batch gather time. Also checks
+// the scalar fp16 conversion against F16C when it is compiled in.
+static int BenchQuantized(const Image& trackImage) {
+    const int STATE = OBSERVATION_SIZE;
+    const int CAPACITY = 100000;
+    const int NUM_ENVS = 8;
+    bool ok = true;
+    std::cout << "=== Quantized replay observations (decode: "
+#if defined(OBSERVATION_CODEC_F16C)
+              << "AVX2 + F16C"
+#elif defined(__AVX2__)
+              << "AVX2, scalar fp16"
+#else
+              << "scalar"
+#endif
+              << ") ===\n";
+
+    {
+        long long halfDiffs = 0, roundTripDiffs = 0;
+        for (uint32_t h = 0; h < 65536; h++) {
+            float value = HalfToFloat((uint16_t)h);
+#ifdef OBSERVATION_CODEC_F16C
+            float hw = _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128((int)h)));
+            if (std::memcmp(&value, &hw, 4) != 0 && !(std::isnan(value) && std::isnan(hw))) halfDiffs++;
+#endif
+            if (!std::isnan(value) && FloatToHalf(value) != (uint16_t)h) roundTripDiffs++;
+        }
+#ifdef OBSERVATION_CODEC_F16C
+        std::mt19937 gen(29);
+        std::uniform_real_distribution<float> value(-2.0f, 2.0f);
+        for (int k = 0; k < 1000000; k++) {
+            float v = (k % 4 == 0) ? value(gen) * 1e-5f : value(gen);
+            uint16_t hw = (uint16_t)_mm_extract_epi16(_mm_cvtps_ph(_mm_set_ss(v), _MM_FROUND_TO_NEAREST_INT), 0);
+            if (FloatToHalf(v) != hw) halfDiffs++;
+        }
+#endif
+        std::cout << "  fp16 conversion: " << roundTripDiffs << " round-trip errors"
+#ifdef OBSERVATION_CODEC_F16C
+                  << ", " << halfDiffs << " differences from F16C"
+#endif
+                  << "\n";
+        ok = ok && halfDiffs == 0 && roundTripDiffs == 0;
+    }
+
+    float lo[OBSERVATION_SIZE], hi[OBSERVATION_SIZE];
+    ObservationBounds(lo, hi);
+    const ObservationEncoding ENCODINGS[] = { ObservationEncoding::Float32, ObservationEncoding::Float16,
+                                              ObservationEncoding::Uint16, ObservationEncoding::Uint8 };
+
+    std::vector<std::unique_ptr<ReplayBuffer>> pairs, frames;
+    for (ObservationEncoding encoding : ENCODINGS) {
+        pairs.emplace_back(new ReplayBuffer(CAPACITY, STATE, ReplayStorage::Pairs));
+        pairs.back()->set_observation_codec(ObservationCodec(encoding, STATE, lo, hi));
+        frames.emplace_back(new ReplayBuffer(CAPACITY, STATE, ReplayStorage::Frames));
+        frames.back()->set_observation_codec(ObservationCodec(encoding, STATE, lo, hi));
+    }
+
+    SurfaceGrid grid = BakeSurfaceGrid(trackImage);
+    LidarSensor lidar(grid, LidarMode::Batch);
+    VecEnv env(grid, lidar, TrackCheckpoints(), NUM_ENVS, 600, 1.0f / 60.0f);
+    std::mt19937 gen(31);
+    std::uniform_int_distribution<int> pick(0, 6);
+    int actions[NUM_ENVS];
+    float outOfRange = 0.0f;
+    for (int step = 0; step < CAPACITY / NUM_ENVS; step++) {
+        for (int& a : actions) a = pick(gen);
+        env.Step(actions);
+        for (int i = 0; i < NUM_ENVS; i++) {
+            const VecEnv::StepResult& result = env.Result(i);
+            const float* state = env.PrevObservation(i);
+            for (int k = 0; k < STATE; k++) {
+                outOfRange = std::max(outOfRange, std::max(lo[k] - state[k], state[k] - hi[k]));
+            }
+            for (size_t e = 0; e < pairs.size(); e++) {
+                pairs[e]->add(state, actions[i], result.reward, env.NextObservation(i), result.done);
+                frames[e]->add(state, actions[i], result.reward, env.NextObservation(i), result.done, i);
+            }
+        }
+    }
+    std::cout << "  observations outside ObservationBounds by at most " << std::max(0.0f, outOfRange) << "\n";
+    ok = ok && outOfRange <= 0.0f;
+
+    struct Group { const char* name; int begin, end; };
+    const Group GROUPS[] = { {"speed", STATE_SPEED, STATE_SPEED + 1},
+                             {"heading", STATE_HEADING_SIN, STATE_HEADING_COS + 1},
+                             {"position", STATE_POS_X, STATE_POS_Y + 1},
+                             {"lidar", STATE_SHORT_LIDAR, STATE_LONG_LIDAR},
+                             {"long lidar", STATE_LONG_LIDAR, OBSERVATION_SIZE} };
+
+    std::cout << "  " << std::left << std::setw(7) << "enc" << std::right << std::setw(10) << "row B"
+              << std::setw(12) << "pairs MB" << std::setw(12) << "frames MB" << std::setw(9) << "vs fp32";
+    for (const Group& group : GROUPS) std::cout << std::setw(12) << group.name;
+    std::cout << std::setw(11) << "b32 us" << std::setw(11) << "b512 us" << "\n";
+
+    std::vector<int> all(CAPACITY);
+    for (int i = 0; i < CAPACITY; i++) all[i] = i;
+    ReplayBatch reference, decoded;
+    reference.resize(CAPACITY, STATE);
+    decoded.resize(CAPACITY, STATE);
+    std::copy(all.begin(), all.end(), reference.indices.begin());
+    pairs[0]->gather(reference.view());
+
+    for (size_t e = 0; e < pairs.size(); e++) {
+        const ObservationCodec& codec = pairs[e]->observation_codec();
+        std::copy(all.begin(), all.end(), decoded.indices.begin());
+        pairs[e]->gather(decoded.view());
+
+        std::vector<float> maxError(STATE, 0.0f);
+        for (size_t r = 0; r < (size_t)CAPACITY; r++) {
+            for (int k = 0; k < STATE; k++) {
+                size_t at = r * STATE + k;
+                maxError[k] = std::max(maxError[k], std::fabs(decoded.states[at] - reference.states[at]));
+                maxError[k] = std::max(maxError[k], std::fabs(decoded.next_states[at] - reference.next_states[at]));
+            }
+        }
+        for (int k = 0; k < STATE; k++) {
+            if (maxError[k] > codec.MaxError(k) + 1e-6f) ok = false;
+        }
+
+        ReplayBatch batch;
+        double b32 = TimePerCall([&]() { pairs[e]->sample(32, batch); }, 64, 0.2) * 1e-3;
+        double b512 = TimePerCall([&]() { pairs[e]->sample(512, batch); }, 8, 0.2) * 1e-3;
+
+        std::cout << "  " << std::left << std::setw(7) << ObservationEncodingName(codec.encoding()) << std::right
+                  << std::setw(10) << codec.RowBytes() << std::fixed << std::setprecision(1)
+                  << std::setw(12) << pairs[e]->Bytes() / 1e6 << std::setw(12) << frames[e]->Bytes() / 1e6
+                  << std::setw(8) << std::setprecision(2) << (double)pairs[0]->Bytes() / pairs[e]->Bytes() << "x"
+                  << std::scientific << std::setprecision(1);
+        for (const Group& group : GROUPS) {
+            float worst = 0.0f;
+            for (int k = group.begin; k < group.end; k++) worst = std::max(worst, maxError[k]);
+            std::cout << std::setw(12) << worst;
+        }
+        std::cout << std::fixed << std::setprecision(2) << std::setw(11) << b32 << std::setw(11) << b512
+                  << std::defaultfloat << "\n";
+    }
+
+// Out-of-cache gather: the encodings pay for decode with fewer bytes per random row.
+    const int LARGE = 2000000;
+    std::cout << "  " << LARGE << " transitions (pairs), batch-32 / batch-512 sample:";
+    for (ObservationEncoding encoding : ENCODINGS) {
+        ReplayBuffer large(LARGE, STATE);
+        large.set_observation_codec(ObservationCodec(encoding, STATE, lo, hi));
+        for (int i = 0; i < LARGE; i++) {
+            const size_t row = (size_t)(i % CAPACITY) * STATE;
+            large.add(&reference.states[row], 0, 0.0f, &reference.next_states[row], false);
+        }
+        ReplayBatch batch;
+        double b32 = TimePerCall([&]() { large.sample(32, batch); }, 64, 0.3) * 1e-3;
+        double b512 = TimePerCall([&]() { large.sample(512, batch); }, 8, 0.3) * 1e-3;
+        std::cout << "  " << ObservationEncodingName(encoding) << " " << std::fixed << std::setprecision(2) << b32
+                  << " / " << b512 << " us" << std::defaultfloat;
+    }
+    std::cout << "\n";
+
+    std::cout << (ok ? "OK: decode errors within one quantization step, fp16 matches IEEE\n"
+                     : "FAIL: quantized replay check\n");
+    return ok ? 0 : 1;
+}
+
+// N-step builder against returns computed from whole recorded episodes: interleaved streams,
+// terminal episode ends and stuck-break resets, for several n. Also checks the bootstrap
+// horizon survives the replay buffer.
+static int BenchNStep() {
+    const int STATE = 4;
+    const int STREAMS = 5;
+    const float GAMMA = 0.99f;
+    bool ok = true;
+    std::cout << "=== N-step returns ===\n";
+
+    struct Step { float state[STATE]; int action; float reward; float next[STATE]; bool done, over; };
+    struct Emitted { float state[STATE]; int action; float reward; float next[STATE]; bool done; int steps; };
+
+    for (int n : {1, 3, 10}) {
+        std::mt19937 gen(37 + n);
+        std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+        std::uniform_int_distribution<int> pick(0, 99);
+        NStepBuilder builder(n, GAMMA, STATE);
+
+        std::vector<std::vector<Emitted>> emitted(STREAMS);
+        std::vector<std::vector<std::vector<Step>>> episodes(STREAMS, std::vector<std::vector<Step>>(1));
+        std::vector<std::vector<float>> current(STREAMS, std::vector<float>(STATE));
+        for (auto& c : current) for (float& v : c) v = value(gen);
+
+        auto emit = [&](const float* st, int a, float r, const float* next, bool d, int stream, int steps) {
+            Emitted e;
+            std::memcpy(e.state, st, sizeof(e.state));
+            std::memcpy(e.next, next, sizeof(e.next));
+            e.action = a;
+            e.reward = r;
+            e.done = d;
+            e.steps = steps;
+            emitted[stream].push_back(e);
+        };
+
+        for (int t = 0; t < 20000; t++) {
+            const int stream = pick(gen) % STREAMS;
+            Step step;
+            std::memcpy(step.state, current[stream].data(), sizeof(step.state));
+            for (float& v : step.next) v = value(gen);
+            step.action = pick(gen) % 7;
+            step.reward = (pick(gen) < 2) ? 500.0f : value(gen);
+            int roll = pick(gen);
+            step.done = roll < 2; // terminal.
+            step.over = roll < 4; // terminal or stuck-break.
+            builder.Push(stream, step.state, step.action, step.reward, step.next, step.done, step.over, emit);
+            episodes[stream].back().push_back(step);
+            if (step.over) {
+                episodes[stream].emplace_back();
+                for (float& v : current[stream]) v = value(gen); // reset observation.
+            } else {
+                std::memcpy(current[stream].data(), step.next, sizeof(step.next));
+            }
+        }
+
+// Reference: transition t of a finished episode of length L bootstraps from step
+// min(t + n, L) - 1's next state; the last episode of each stream is still open.
+        long long expected = 0, mismatches = 0;
+        for (int stream = 0; stream < STREAMS; stream++) {
+            size_t out = 0;
+            for (const std::vector<Step>& ep : episodes[stream]) {
+                const int L = (int)ep.size();
+                const bool open = (&ep == &episodes[stream].back());
+                for (int t = 0; t < L; t++) {
+                    const int end = std::min(t + n, L);
+                    if (open && t + n > L) break; // not emitted yet.
+                    expected++;
+                    float ret = 0.0f, discount = 1.0f;
+                    for (int k = t; k < end; k++) {
+                        ret += discount * ep[k].reward;
+                        discount *= GAMMA;
+                    }
+                    const bool done = (end == L) && ep[L - 1].done;
+                    if (out >= emitted[stream].size()) {
+                        mismatches++;
+                        continue;
+                    }
+                    const Emitted& e = emitted[stream][out++];
+                    if (std::memcmp(e.state, ep[t].state, sizeof(e.state)) != 0 ||
+                        std::memcmp(e.next, ep[end - 1].next, sizeof(e.next)) != 0 || e.action != ep[t].action ||
+                        std::fabs(e.reward - ret) > 1e-3f * (1.0f + std::fabs(ret)) || e.done != done ||
+                        e.steps != end - t) {
+                        mismatches++;
+                    }
+                }
+            }
+            if (out != emitted[stream].size()) mismatches++;
+        }
+        long long total = 0;
+        for (auto& e : emitted) total += (long long)e.size();
+        std::cout << "  n=" << std::setw(2) << n << ": " << total << " / " << expected << " transitions, "
+                  << mismatches << " mismatches\n";
+        ok = ok && mismatches == 0 && total == expected;
+    }
+
+// Bootstrap horizons come back out of sampling.
+    {
+        ReplayBuffer buffer(1000, STATE);
+        std::vector<float> row(STATE, 0.0f);
+        for (int i = 0; i < 1000; i++) {
+            row[0] = (float)(i % 7 + 1);
+            buffer.add(row.data(), 0, 0.0f, row.data(), false, 0, i % 7 + 1);
+        }
+        ReplayBatch batch;
+        buffer.sample(256, batch);
+        int bad = 0;
+        for (int i = 0; i < 256; i++) {
+            if (batch.steps[i] != batch.states[(size_t)i * STATE]) bad++;
+        }
+        std::cout << "  replay round trip of bootstrap horizons: " << bad << " mismatches\n";
+        ok = ok && bad == 0;
+    }
+
+    std::cout << (ok ? "OK: n-step transitions match the episode returns\n" : "FAIL: n-step check\n");
+    return ok ? 0 : 1;
+}
+
+// Policy inference for N observations: N single-row predict calls (libtorch) against one
+// batched libtorch forward (predict_batch_torch) and the fused kernel behind predict_batch
+// (Q-values) and predict_actions (argmax). Checks the kernel against predict, also after a
+// train step (the kernel must pick up the new weights).
+static int BenchInference(const std::vector<int>& counts) {
+    const int STATE = OBSERVATION_SIZE;
+    const float TOLERANCE = 1e-5f;
+    bool ok = true;
+    std::mt19937 gen(41);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+    DQN dqn(STATE, ACTION_COUNT);
+
+// Max |Q diff| of predict_batch against predict, and argmax picks that are worse than predict's
+// best by more than the tolerance (near-ties may legitimately flip).
+    auto check = [&](const std::vector<float>& states, int n, float& maxDiff, int& actionDiffs) {
+        std::vector<float> q((size_t)n * ACTION_COUNT);
+        std::vector<int> actions(n);
+        dqn.predict_batch(states.data(), n, q.data());
+        dqn.predict_actions(states.data(), n, actions.data());
+        maxDiff = 0.0f;
+        actionDiffs = 0;
+        for (int i = 0; i < n; i++) {
+            std::vector<float> single = dqn.predict(&states[(size_t)i * STATE]);
+            for (int a = 0; a < ACTION_COUNT; a++) {
+                maxDiff = std::max(maxDiff, std::fabs(single[a] - q[(size_t)i * ACTION_COUNT + a]));
+            }
+            float best = *std::max_element(single.begin(), single.end());
+            if (single[actions[i]] < best - TOLERANCE) actionDiffs++;
+        }
+    };
+
+    std::cout << "=== Policy inference, kernel " << PolicyKernel::Path() << ", " << torch::get_num_threads()
+              << " torch threads ===\n";
+    std::cout << std::left << std::setw(7) << "N" << std::setw(16) << "path" << std::right << std::setw(13)
+              << "call us" << std::setw(13) << "us / obs" << std::setw(14) << "obs / s" << std::setw(10)
+              << "speedup" << "\n";
+
+    for (int n : counts) {
+        std::vector<float> states((size_t)n * STATE);
+        for (float& v : states) v = value(gen);
+        std::vector<float> q((size_t)n * ACTION_COUNT);
+        std::vector<int> actions(n);
+
+        float maxDiff;
+        int actionDiffs;
+        check(states, n, maxDiff, actionDiffs);
+        ok = ok && maxDiff <= TOLERANCE && actionDiffs == 0;
+
+        double loopNs = TimePerCall([&]() {
+            for (int i = 0; i < n; i++) {
+                std::vector<float> single = dqn.predict(&states[(size_t)i * STATE]);
+                actions[i] = (int)(std::max_element(single.begin(), single.end()) - single.begin());
+            }
+        }, 4, 0.5);
+        double torchNs = TimePerCall([&]() { dqn.predict_batch_torch(states.data(), n, q.data()); }, 4, 0.5);
+        double batchNs = TimePerCall([&]() { dqn.predict_batch(states.data(), n, q.data()); }, 4, 0.5);
+        double actionNs = TimePerCall([&]() { dqn.predict_actions(states.data(), n, actions.data()); }, 4, 0.5);
+
+        auto row = [&](const char* path, double ns) {
+            std::cout << std::left << std::setw(7) << n << std::setw(16) << path << std::right << std::fixed
+                      << std::setprecision(2) << std::setw(13) << ns * 1e-3 << std::setw(13) << ns * 1e-3 / n
+                      << std::setprecision(0) << std::setw(14) << n / (ns * 1e-9) << std::setprecision(1)
+                      << std::setw(9) << loopNs / ns << "x" << std::defaultfloat << "\n";
+        };
+        row("predict x N", loopNs);
+        row("torch batch", torchNs);
+        row("predict_batch", batchNs);
+        row("predict_actions", actionNs);
+        std::cout << "       max |Q diff| vs predict " << maxDiff << ", argmax differences " << actionDiffs << "\n";
+    }
+
+    {
+        const int BATCH = 32;
+        std::vector<float> states((size_t)BATCH * STATE), nextStates((size_t)BATCH * STATE);
+        std::vector<int64_t> actions(BATCH);
+        std::vector<float> rewards(BATCH), dones(BATCH, 0.0f);
+        for (float& v : states) v = value(gen);
+        for (float& v : nextStates) v = value(gen);
+        for (int i = 0; i < BATCH; i++) {
+            actions[i] = i % ACTION_COUNT;
+            rewards[i] = value(gen);
+        }
+        for (int step = 0; step < 10; step++) {
+            dqn.train(states.data(), actions.data(), rewards.data(), nextStates.data(), dones.data(), BATCH);
+        }
+
+        float maxDiff;
+        int actionDiffs;
+        check(states, BATCH, maxDiff, actionDiffs);
+        std::cout << "  after 10 train steps: max |Q diff| vs predict " << maxDiff << ", argmax differences "
+                  << actionDiffs << "\n";
+        ok = ok && maxDiff <= TOLERANCE && actionDiffs == 0;
+    }
+
+    std::cout << (ok ? "OK: kernel inference matches predict\n" : "FAIL: kernel inference differs from predict\n");
+    return ok ? 0 : 1;
+}
+
+// Native learner (hand-written forward/backward, NativeLearner) against the libtorch train step:
+// two DQNs start from the same weights and train on the same prioritized-style batches
+// (weights, n-step horizons); losses, TD errors and parameters must agree after one step and
+// stay close over many. Then times update steps per second at each batch size.
+static int BenchNativeLearner(const std::vector<int>& batchSizes) {
+    const int STATE = OBSERVATION_SIZE;
+    const int CAPACITY = 50000;
+    const int STEPS = 500;
+    bool ok = true;
+
+    std::mt19937 gen(23);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> pickAction(0, ACTION_COUNT - 1);
+    ReplayBuffer ring(CAPACITY, STATE);
+    std::vector<float> state(STATE), next(STATE);
+    for (int i = 0; i < CAPACITY; i++) {
+        for (int k = 0; k < STATE; k++) {
+            state[k] = value(gen);
+            next[k] = value(gen);
+        }
+        ring.add(state.data(), pickAction(gen), value(gen), next.data(), (i % 500) == 499, 0, 1 + i % 3);
+    }
+
+    DQN torchDqn(STATE, ACTION_COUNT);
+    DQN nativeDqn(STATE, ACTION_COUNT);
+    const size_t count = torchDqn.parameter_count();
+    std::vector<float> policy(count), target(count), nativePolicy(count), nativeTarget(count);
+    torchDqn.read_parameters(policy.data(), target.data());
+    nativeDqn.write_parameters(policy.data(), target.data());
+    nativeDqn.set_native_learner(true);
+
+    std::cout << "=== Native learner vs libtorch, " << count << " parameters ===\n";
+    const int BATCH = 32;
+    DQN::TrainBatch& torchBatch = torchDqn.train_batch(BATCH);
+    DQN::TrainBatch& nativeBatch = nativeDqn.train_batch(BATCH);
+    for (int step = 1; step <= STEPS; step++) {
+        ring.sample(torchBatch.view());
+        for (int i = 0; i < BATCH; i++) torchBatch.weights.data_ptr<float>()[i] = 0.5f + 0.5f * std::fabs(value(gen));
+        nativeBatch.states.copy_(torchBatch.states);
+        nativeBatch.actions.copy_(torchBatch.actions);
+        nativeBatch.rewards.copy_(torchBatch.rewards);
+        nativeBatch.next_states.copy_(torchBatch.next_states);
+        nativeBatch.dones.copy_(torchBatch.dones);
+        nativeBatch.weights.copy_(torchBatch.weights);
+        nativeBatch.steps.copy_(torchBatch.steps);
+
+        float torchLoss = torchDqn.train(torchBatch, true);
+        float nativeLoss = nativeDqn.train(nativeBatch, true);
+        if (step != 1 && step != STEPS) continue;
+
+        float tdDiff = 0.0f;
+        for (int i = 0; i < BATCH; i++) {
+            tdDiff = std::max(tdDiff, std::fabs(torchBatch.td_errors.data_ptr<float>()[i] -
+                                                nativeBatch.td_errors.data_ptr<float>()[i]));
+        }
+        torchDqn.read_parameters(policy.data(), target.data());
+        nativeDqn.read_parameters(nativePolicy.data(), nativeTarget.data());
+        float paramDiff = 0.0f, targetDiff = 0.0f;
+        int off = 0;
+        for (size_t p = 0; p < count; p++) {
+            float d = std::fabs(policy[p] - nativePolicy[p]);
+            paramDiff = std::max(paramDiff, d);
+            targetDiff = std::max(targetDiff, std::fabs(target[p] - nativeTarget[p]));
+            if (d > 1e-5f) off++;
+        }
+
+// Q-values of both nets on the batch states.
+        std::vector<float> torchQ((size_t)BATCH * ACTION_COUNT), nativeQ((size_t)BATCH * ACTION_COUNT);
+        torchDqn.predict_batch_torch(torchBatch.states.data_ptr<float>(), BATCH, torchQ.data());
+        nativeDqn.predict_batch(torchBatch.states.data_ptr<float>(), BATCH, nativeQ.data());
+        double qDiff = 0.0, qScale = 0.0;
+        for (size_t k = 0; k < torchQ.size(); k++) {
+            qDiff += std::fabs(torchQ[k] - nativeQ[k]);
+            qScale += std::fabs(torchQ[k]);
+        }
+        const float lossRel = std::fabs(torchLoss - nativeLoss) / std::max(1e-6f, std::fabs(torchLoss));
+
+        std::cout << "  step " << step << ": loss " << torchLoss << " vs " << nativeLoss << " (rel " << lossRel
+                  << "), max |TD diff| " << tdDiff << ", max |param diff| " << paramDiff << " (" << off
+                  << " > 1e-5), max |target diff| " << targetDiff << ", mean |Q diff| / mean |Q| "
+                  << qDiff / std::max(1e-12, qScale) << "\n";
+        if (step == 1) {
+// One step: same math up to summation order. Adam divides by |g|, so a parameter whose
+// true gradient is ~0 can move by a different fraction of lr; allow a handful.
+            ok = ok && lossRel <= 1e-5f && tdDiff <= 1e-5f && off <= (int)(count / 1000);
+        } else {
+            ok = ok && qDiff / std::max(1e-12, qScale) <= 1e-3;
+        }
+    }
+
+    std::cout << std::left << std::setw(8) << "batch" << std::setw(10) << "path" << std::right << std::setw(14)
+              << "step us" << std::setw(14) << "steps / s" << std::setw(10) << "speedup" << "\n";
+    for (int batchSize : batchSizes) {
+        ReplayBatch flat;
+        ring.sample(batchSize, flat);
+        nativeDqn.set_native_learner(false);
+        double torchNs = TimePerCall([&]() {
+            nativeDqn.train(flat.states.data(), flat.actions.data(), flat.rewards.data(), flat.next_states.data(),
+                            flat.dones.data(), batchSize, flat.weights.data(), nullptr);
+        }, 8, 1.0);
+        nativeDqn.set_native_learner(true);
+        double nativeNs = TimePerCall([&]() {
+            nativeDqn.train(flat.states.data(), flat.actions.data(), flat.rewards.data(), flat.next_states.data(),
+                            flat.dones.data(), batchSize, flat.weights.data(), nullptr);
+        }, 8, 1.0);
+
+        auto row = [&](const char* name, double ns) {
+            std::cout << std::left << std::setw(8) << batchSize << std::setw(10) << name << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(14) << ns / 1000.0 << std::setprecision(0) << std::setw(14)
+                      << 1e9 / ns << std::setprecision(1) << std::setw(9) << torchNs / ns << "x" << "\n"
+                      << std::defaultfloat;
+        };
+        row("torch", torchNs);
+        row("native", nativeNs);
+    }
+
+    std::cout << (ok ? "OK: native learner matches the libtorch update\n" : "FAIL: native learner differs from libtorch\n");
+    return ok ? 0 : 1;
+}
+
+// Flat parameter buffers: the polyak update must equal tau * p + (1 - tau) * t exactly, optimizer
+// steps must land in the flat buffer (the nets compute with what a snapshot reads), and the
+// per-step weight operations are timed for the libtorch and native learners.
+static int BenchParameters() {
+    const int STATE = OBSERVATION_SIZE;
+    const int HIDDEN = 64;
+    const int BATCH = 32;
+    const float TAU = 0.005f;
+    bool ok = true;
+
+    std::mt19937 gen(29);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    DQN dqn(STATE, ACTION_COUNT);
+    const size_t count = dqn.parameter_count();
+    std::vector<float> policy(count), target(count), after(count), afterTarget(count);
+    std::cout << "=== Flat parameter buffers, " << count << " parameters ===\n";
+
+// Make the target differ from the policy first (they start equal).
+    ReplayBatch batch;
+    batch.resize(BATCH, STATE);
+    for (float& v : batch.states) v = value(gen);
+    for (float& v : batch.next_states) v = value(gen);
+    for (int i = 0; i < BATCH; i++) {
+        batch.actions[i] = i % ACTION_COUNT;
+        batch.rewards[i] = value(gen);
+        batch.dones[i] = 0.0f;
+    }
+    auto train = [&]() {
+        dqn.train(batch.states.data(), batch.actions.data(), batch.rewards.data(), batch.next_states.data(),
+                  batch.dones.data(), BATCH);
+    };
+    for (int step = 0; step < 5; step++) train();
+
+    dqn.read_parameters(policy.data(), target.data());
+    dqn.soft_update_target(TAU);
+    dqn.read_parameters(after.data(), afterTarget.data());
+    int polyakOff = 0;
+    for (size_t p = 0; p < count; p++) {
+        if (afterTarget[p] != TAU * policy[p] + (1.0f - TAU) * target[p]) polyakOff++;
+    }
+    std::cout << "  polyak update: " << polyakOff << " parameters differ from tau * p + (1 - tau) * t\n";
+    ok = ok && polyakOff == 0;
+
+    train();
+    dqn.read_parameters(after.data());
+    int moved = 0;
+    for (size_t p = 0; p < count; p++) moved += (after[p] != policy[p]) ? 1 : 0;
+
+// The torch forward against a kernel built from the snapshot alone.
+    PolicyKernel snapshot;
+    snapshot.LoadFlat(STATE, HIDDEN, ACTION_COUNT, after.data());
+    std::vector<float> q(ACTION_COUNT);
+    float maxDiff = 0.0f;
+    for (int i = 0; i < BATCH; i++) {
+        const float* row = &batch.states[(size_t)i * STATE];
+        std::vector<float> torchQ = dqn.predict(row);
+        snapshot.Forward(row, 1, q.data());
+        for (int a = 0; a < ACTION_COUNT; a++) maxDiff = std::max(maxDiff, std::fabs(torchQ[a] - q[a]));
+    }
+    std::cout << "  train step moved " << moved << " parameters in the flat buffer; predict vs snapshot max |Q diff| "
+              << maxDiff << "\n";
+    ok = ok && moved > 0 && maxDiff <= 1e-5f;
+
+    std::cout << std::left << std::setw(10) << "learner" << std::setw(20) << "operation" << std::right
+              << std::setw(12) << "us / call" << "\n";
+    for (bool native : {false, true}) {
+        dqn.set_native_learner(native);
+        auto row = [&](const char* name, double ns) {
+            std::cout << std::left << std::setw(10) << (native ? "native" : "torch") << std::setw(20) << name
+                      << std::right << std::fixed << std::setprecision(2) << std::setw(12) << ns / 1000.0 << "\n"
+                      << std::defaultfloat;
+        };
+        row("soft update", TimePerCall([&]() { dqn.soft_update_target(TAU); }, 64, 0.5));
+        row("hard update", TimePerCall([&]() { dqn.update_target_network(); }, 64, 0.5));
+        row("snapshot", TimePerCall([&]() { dqn.read_parameters(after.data()); }, 64, 0.5));
+    }
+
+    std::cout << (ok ? "OK: flat parameter buffers\n" : "FAIL: flat parameter buffers\n");
+    return ok ? 0 : 1;
+}
+
+// Async learner. Snapshot stress: a publisher thread flips policy snapshots whose every
+// parameter is k, while a reader refreshes a kernel from them and checks Q(0) is exactly the
+// value of a whole-k network, so a torn copy would show up as a foreign value. Then the
+// trainer's loop on real cars for a fixed wall time, inline train every 3 steps against the
+// learner thread (ratio-capped and free-running): actor steps/s, updates/s, replay ratio.
+static int BenchAsyncLearner(const Image& trackImage, const std::vector<int>& envCounts) {
+    const int STATE = OBSERVATION_SIZE;
+    const int HIDDEN = 64;
+    const int BATCH = 32;
+    const int TRAIN_EVERY = 3;
+    const double SECONDS = 3.0;
+    bool ok = true;
+    std::cout << "=== Async learner (" << std::thread::hardware_concurrency() << " hardware threads) ===\n";
+
+    {
+        DQN dqn(STATE, ACTION_COUNT);
+        const size_t count = dqn.parameter_count();
+        PolicySnapshot snapshot(STATE, HIDDEN, ACTION_COUNT, count);
+// Every weight and bias k, input 0: h1 = k, h2 = HIDDEN k^2 + k, Q = HIDDEN k h2 + k, exact in
+// float for k <= 10.
+        auto expected = [&](int k) {
+            const double h2 = (double)HIDDEN * k * k + k;
+            return (float)((double)HIDDEN * k * h2 + k);
+        };
+        const int PUBLISHES = 20000;
+        std::thread publisher([&]() {
+            for (int v = 1; v <= PUBLISHES; v++) {
+                std::fill(snapshot.back(), snapshot.back() + count, (float)(1 + v % 10));
+                snapshot.Publish();
+            }
+        });
+        PolicyKernel kernel;
+        uint64_t version = 0, lastVersion = 0;
+        std::vector<float> zero(STATE, 0.0f), q(ACTION_COUNT);
+        long long refreshes = 0, torn = 0, backwards = 0;
+        while (version < (uint64_t)PUBLISHES) {
+            if (!snapshot.Refresh(kernel, version)) continue;
+            refreshes++;
+            if (version < lastVersion) backwards++;
+            lastVersion = version;
+            kernel.Forward(zero.data(), 1, q.data());
+            const int k = 1 + (int)(version % 10);
+            for (int a = 0; a < ACTION_COUNT; a++) {
+                if (q[a] != expected(k)) torn++;
+            }
+        }
+        publisher.join();
+        std::cout << "  snapshot stress: " << PUBLISHES << " publishes, " << refreshes << " refreshes, " << torn
+                  << " torn Q values, " << backwards << " version regressions\n";
+        ok = ok && torn == 0 && backwards == 0 && refreshes > 0;
+    }
+
+    SurfaceGrid grid = BakeSurfaceGrid(trackImage);
+    LidarSensor lidar(grid, LidarMode::Batch);
+    std::cout << std::left << std::setw(6) << "cars" << std::setw(22) << "learner" << std::right << std::setw(16)
+              << "actor steps/s" << std::setw(14) << "updates/s" << std::setw(14) << "replay ratio"
+              << std::setw(12) << "snapshots" << "\n";
+    for (int cars : envCounts) {
+        for (int mode = 0; mode < 3; mode++) {
+            const bool async = mode > 0;
+            const float cap = (mode == 1) ? (float)BATCH / TRAIN_EVERY : 0.0f;
+            torch::manual_seed(7);
+            DQN dqn(STATE, ACTION_COUNT);
+            ReplayBuffer buffer(100000, STATE);
+            VecEnv env(grid, lidar, TrackCheckpoints(), cars, 7500, 1.0f / 60.0f);
+            Rng explore(11, RNG_STREAM_EXPLORATION);
+            std::vector<int> actions(cars);
+
+// Random warmup so every mode starts from a buffer that can be sampled.
+            while (!buffer.can_sample(BATCH * 8)) {
+                for (int& a : actions) a = (int)explore.NextInt(ACTION_COUNT);
+                env.Step(actions.data());
+                for (int i = 0; i < cars; i++) {
+                    buffer.add(env.PrevObservation(i), actions[i], env.Result(i).reward, env.NextObservation(i),
+                               env.Result(i).done, i);
+                }
+            }
+
+            DQN::TrainBatch& batch = dqn.train_batch(BATCH);
+            std::unique_ptr<AsyncLearner> learner;
+            PolicyKernel policy;
+            uint64_t version = 0;
+            if (async) {
+                learner.reset(new AsyncLearner(dqn, buffer, BATCH, false, 50, cap));
+                learner->Start();
+            }
+
+            long long steps = 0, updates = 0;
+            auto start = std::chrono::steady_clock::now();
+            double seconds = 0.0;
+            while (seconds < SECONDS) {
+                if (learner) {
+                    learner->snapshot().Refresh(policy, version);
+                    policy.Act(env.Observations(), cars, actions.data());
+                } else {
+                    dqn.predict_actions(env.Observations(), cars, actions.data());
+                }
+                env.Step(actions.data());
+                steps += cars;
+                if (learner) learner->AddActorSteps(cars);
+                for (int i = 0; i < cars; i++) {
+                    const VecEnv::StepResult& result = env.Result(i);
+                    if (learner) {
+                        std::lock_guard<std::mutex> lock(learner->mutex());
+                        buffer.add(env.PrevObservation(i), actions[i], result.reward, env.NextObservation(i), result.done, i);
+                    } else {
+                        buffer.add(env.PrevObservation(i), actions[i], result.reward, env.NextObservation(i), result.done, i);
+                        if (result.episodeSteps % TRAIN_EVERY == 0) {
+                            buffer.sample(batch.view());
+                            dqn.train(batch, false);
+                            updates++;
+                        }
+                    }
+                }
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            long long snapshots = 0;
+            if (learner) {
+                learner->Stop();
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                AsyncLearner::Stats ls = learner->stats();
+                updates = ls.updates;
+                snapshots = ls.published;
+                if (cap > 0.0f && (double)updates * BATCH > cap * steps + BATCH) ok = false;
+            }
+
+            std::string name = !async ? "inline (every 3)" : (cap > 0.0f ? "thread, ratio cap" : "thread, free");
+            std::cout << std::left << std::setw(6) << cars << std::setw(22) << name << std::right << std::fixed
+                      << std::setprecision(0) << std::setw(16) << steps / seconds << std::setprecision(1)
+                      << std::setw(14) << updates / seconds << std::setprecision(2) << std::setw(14)
+                      << (double)updates * BATCH / steps << std::setw(12) << (async ? std::to_string(snapshots) : "-")
+                      << std::defaultfloat << "\n";
+        }
+    }
+
+    std::cout << (ok ? "OK: async learner\n" : "FAIL: async learner\n");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode = (argc > 1) ? argv[1] : "lidar";
+
+    SetTraceLogLevel(LOG_ERROR);
+
+    Image trackImage = LoadImage("assets/raceTrackFullyWalled.png");
+    if (trackImage.data == NULL) {
+        std::cerr << "Failed to load track image!\n";
+        return 1;
+    }
+
+    int rc = 0;
+    if (mode == "lidar") {
+        rc = BenchLidar(trackImage);
+    } else if (mode == "lut") {
+        rc = BenchLidarTable(trackImage);
+    } else if (mode == "alloc") {
+        rc = BenchAllocations(trackImage);
+    } else if (mode == "replay") {
+        std::vector<int> capacities;
+        for (int i = 2; i < argc; i++) capacities.push_back(std::atoi(argv[i]));
+        if (capacities.empty()) capacities = {50000, 1000000, 10000000};
+        rc = BenchReplay(trackImage, capacities);
+    } else if (mode == "per") {
+        std::vector<int> capacities;
+        for (int i = 2; i < argc; i++) capacities.push_back(std::atoi(argv[i]));
+        if (capacities.empty()) capacities = {50000, 1000000, 10000000};
+        rc = BenchPrioritized(capacities);
+    } else if (mode == "rng") {
+        rc = BenchRng();
+    } else if (mode == "mpreplay") {
+        std::vector<int> producerCounts;
+        for (int i = 2; i < argc; i++) producerCounts.push_back(std::atoi(argv[i]));
+        if (producerCounts.empty()) producerCounts = {1, 2, 4, 8, 16, 32};
+        rc = BenchConcurrentReplay(producerCounts);
+    } else if (mode == "mmreplay") {
+        int capacity = (argc > 2) ? std::atoi(argv[2]) : 100000000;
+        int fill = (argc > 3) ? std::atoi(argv[3]) : 2000000;
+        rc = BenchMappedReplay(capacity, fill);
+    } else if (mode == "quant") {
+        rc = BenchQuantized(trackImage);
+    } else if (mode == "nstep") {
+        rc = BenchNStep();
+    } else if (mode == "inference") {
+        std::vector<int> counts;
+        for (int i = 2; i < argc; i++) counts.push_back(std::atoi(argv[i]));
+        if (counts.empty()) counts = {1, 8, 64, 256};
+        rc = BenchInference(counts);
+    } else if (mode == "native") {
+        std::vector<int> batchSizes;
+        for (int i = 2; i < argc; i++) batchSizes.push_back(std::atoi(argv[i]));
+        if (batchSizes.empty()) batchSizes = {32, 512};
+        rc = BenchNativeLearner(batchSizes);
+    } else if (mode == "params") {
+        rc = BenchParameters();
+    } else if (mode == "async") {
+        std::vector<int> envCounts;
+        for (int i = 2; i < argc; i++) envCounts.push_back(std::atoi(argv[i]));
+        if (envCounts.empty()) envCounts = {1, 8};
+        rc = BenchAsyncLearner(trackImage, envCounts);
+    } else if (mode == "learner") {
+        std::vector<int> batchSizes;
+        for (int i = 2; i < argc; i++) batchSizes.push_back(std::atoi(argv[i]));
+        if (batchSizes.empty()) batchSizes = {32, 512};
+        rc = BenchLearner(batchSizes);
+    } else {
+        std::cout << "Usage: racing_bench <lidar|lut|alloc|replay [capacity...]|per [capacity...]|learner [batch...]|rng|mpreplay [producers...]|mmreplay [capacity [fill]]|quant|nstep|inference [n...]|native [batch...]|params|async [envs...]>\n";
+        rc = 1;
+    }
+
+    UnloadImage(trackImage);
+    return rc;
+}
@@ -0,0 +1,172 @@
+#ifndef RACING_ENV_H
+#define RACING_ENV_H
+
+#include "raylib.h"
+#include "surface_grid.h"
+
+#include <cmath>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+// Line across the track. Which checkpoints were crossed this lap is race state (racing_sim.h).
+struct Checkpoint {
+    Vector2 start;
+    Vector2 end;
+
+    bool CheckCrossing(Vector2 prevPos, Vector2 currentPos) const {
+        float x1 = prevPos.x, y1 = prevPos.y;
+        float x2 = currentPos.x, y2 = currentPos.y;
+        float x3 = start.x,  y3 = start.y;
+        float x4 = end.x,    y4 = end.y;
+
+        float denom = (x1 - x2) * (y3 - y4) - (y1 - y2) * (x3 - x4);
+        if (fabs(denom) < 0.001f) return false;
+
+        float t = ((x1 - x3) * (y3 - y4) - (y1 - y3) * (x3 - x4)) / denom;
+        float u = -((x1 - x2) * (y1 - y3) - (y1 - y2) * (x1 - x3)) / denom;
+
+        return (t >= 0 && t <= 1 && u >= 0 && u <= 1);
+    }
+};
+
+// LIDAR ray cast (reference marcher over the raw image; the simulator uses SurfaceGrid).
+inline float CastLIDARRay(const Image& trackImage, Vector2 position, float angle, float maxDistance) {
+    float distance = 0.0f;
+    const float step = 2.0f;
+
+    while (distance < maxDistance) {
+        float checkX = position.x + cos(angle) * distance;
+        float checkY = position.y + sin(angle) * distance;
+
+        int pixelX = (int)checkX;
+        int pixelY = (int)checkY;
+
+        if (pixelX < 0 || pixelX >= trackImage.width ||
+            pixelY < 0 || pixelY >= trackImage.height) {
+            return distance;
+        }
+
+        Color pixel = GetImageColor(trackImage, pixelX, pixelY);
+        if (IsWall(pixel)) return distance;
+
+        distance += step;
+    }
+
+    return maxDistance;
+}
+
+// LIDAR ray layout: 13 short-range danger rays, 5 long-range anticipation rays.
+constexpr float LIDAR_RANGE = 200.0f;
+constexpr float REFERENCE_DIST = 50.0f; // Distance at which danger ~= 1.0.
+constexpr float LONG_RANGE = 900.0f; // tune 700..1200 depending on track scale.
+
+constexpr float LIDAR_SHORT_OFFSETS[13] = {
+    -PI/2, // -90
+    -5*PI/12, // -75
+    -PI/3, // -60
+    -PI/4, // -45
+    -PI/6, // -30
+    -PI/12, // -15
+    0.0f, // 0
+    PI/12, // +15
+    PI/6, // +30
+    PI/4, // +45
+    PI/3, // +60
+    5*PI/12, // +75
+    PI/2 // +90
+};
+
+constexpr float LIDAR_LONG_OFFSETS[5] = {
+    -PI/6, // -30
+    -PI/12, // -15
+    0.0f, // 0
+    PI/12, // +15
+    PI/6 // +30
+};
+
+constexpr int LIDAR_SHORT_COUNT = (int)(sizeof(LIDAR_SHORT_OFFSETS) / sizeof(LIDAR_SHORT_OFFSETS[0]));
+constexpr int LIDAR_LONG_COUNT = (int)(sizeof(LIDAR_LONG_OFFSETS) / sizeof(LIDAR_LONG_OFFSETS[0]));
+
+// Observation layout: 5 base + 13 short-range lidar (danger) + 5 long-range anticipation (distance) = 23 dims.
+constexpr int STATE_SPEED = 0;
+constexpr int STATE_HEADING_SIN = 1;
+constexpr int STATE_HEADING_COS = 2;
+constexpr int STATE_POS_X = 3;
+constexpr int STATE_POS_Y = 4;
+constexpr int STATE_SHORT_LIDAR = 5;
+constexpr int STATE_LONG_LIDAR = STATE_SHORT_LIDAR + LIDAR_SHORT_COUNT;
+constexpr int OBSERVATION_SIZE = STATE_LONG_LIDAR + LIDAR_LONG_COUNT;
+static_assert(OBSERVATION_SIZE == 23, "DQN input size and saved models assume 23 features");
+
+typedef std::array<float, OBSERVATION_SIZE> Observation;
+
+// Range of every observation feature, for quantized storage. Speed runs from -0.5 (reverse is
+// capped at half the top speed) to 1; the rest are sin/cos, normalized position or clamped
+// LIDAR values.
+inline void ObservationBounds(float* lo, float* hi) {
+    for (int k = 0; k < OBSERVATION_SIZE; k++) {
+        lo[k] = 0.0f;
+        hi[k] = 1.0f;
+    }
+    lo[STATE_SPEED] = -0.5f;
+    lo[STATE_HEADING_SIN] = -1.0f;
+    lo[STATE_HEADING_COS] = -1.0f;
+}
+
+// Writes the observation into state[0..OBSERVATION_SIZE) without allocating.
+// Track is anything with width/height and a CastLIDARRay overload
+// (Image, SurfaceGrid, DistanceField, WallMask, LidarSensor, ...).
+template <class Track>
+void GetState(const Track& trackImage, Vector2 position, float angle, float speed, float* state) {
+    const float MAX_SPEED = 300.0f;
+    state[STATE_SPEED] = speed / MAX_SPEED;
+
+    state[STATE_HEADING_SIN] = sin(angle);
+    state[STATE_HEADING_COS] = cos(angle);
+
+    state[STATE_POS_X] = position.x / (float)trackImage.width;
+    state[STATE_POS_Y] = position.y / (float)trackImage.height;
+
+// Short-range rays
+    for (int k = 0; k < LIDAR_SHORT_COUNT; k++) {
+        float d = CastLIDARRay(trackImage, position, angle + LIDAR_SHORT_OFFSETS[k], LIDAR_RANGE);
+
+// Inverse normalization: close walls = high value.
+        float danger = 1.0f / ((d / REFERENCE_DIST) + 0.1f);
+        state[STATE_SHORT_LIDAR + k] = std::min(1.0f, danger);
+    }
+
+// Long-range anticipation rays
+// These help the network "see" a turn earlier without changing your short-range "danger" behavior.
+    for (int k = 0; k < LIDAR_LONG_COUNT; k++) {
+        float d = CastLIDARRay(trackImage, position, angle + LIDAR_LONG_OFFSETS[k], LONG_RANGE);
+        float norm = d / LONG_RANGE; // 0..1 where 1 means far/clear.
+        if (norm < 0.0f) norm = 0.0f;
+        if (norm > 1.0f) norm = 1.0f;
+        state[STATE_LONG_LIDAR + k] = norm;
+    }
+}
+
+template <class Track>
+void GetState(const Track& trackImage, Vector2 position, float angle, float speed, Observation& state) {
+    GetState(trackImage, position, angle, speed, state.data());
+}
+
+// Allocating convenience form (tools and tests; the step loops use the forms above).
+template <class Track>
+std::vector<float> GetState(const Track& trackImage, Vector2 position, float angle, float speed) {
+    std::vector<float> state(OBSERVATION_SIZE);
+    GetState(trackImage, position, angle, speed, state.data());
+    return state;
+}
+
+inline float DistToCheckpointMid(const std::vector<Checkpoint>& checkpoints, int cpIndex, Vector2 p) {
+    const Checkpoint& cp = checkpoints[cpIndex];
+    Vector2 mid = { (cp.start.x + cp.end.x) * 0.5f, (cp.start.y + cp.end.y) * 0.5f };
+    float dx = mid.x - p.x;
+    float dy = mid.y - p.y;
+    return sqrtf(dx*dx + dy*dy);
+}
+
+#endif // RACING_ENV_H
@@ -0,0 +1,259 @@
+#ifndef RACING_SIM_H
+#define RACING_SIM_H
+
+#include "raylib.h"
+#include "surface_grid.h"
+#include "racing_env.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// Shared simulation core: car physics, wall bounce, action mapping and checkpoint/lap rules.
+// VecEnv (training), EvaluateGreedy, racing_replay and the playable game all step cars through
+// these functions, so a rule or speed change lands everywhere with identical semantics.
+
+// Physics parameters. Alternative tunings can be passed as the Physics template argument.
+struct CarPhysics {
+    static constexpr float MAX_SPEED = 300.0f;
+    static constexpr float ACCELERATION = 150.0f;
+    static constexpr float BRAKE_FORCE = 200.0f; // keyboard brake (game only).
+    static constexpr float FRICTION = 50.0f;
+    static constexpr float TURN_SPEED_BASE = 3.0f;
+    static constexpr float TURN_SPEED_FACTOR = 0.3f;
+    static constexpr float WALL_BOUNCE = -0.3f; // speed multiplier when hitting a wall.
+    static constexpr float SLOW_SURFACE = 2.0f; // friction above this halves the top speed (grass).
+};
+
+constexpr int TOTAL_LAPS = 3;
+constexpr Vector2 START_POSITION = {430.0f, 92.0f};
+constexpr float START_ANGLE = 0.0f;
+constexpr const char* TRACK_IMAGE_PATH = "assets/raceTrackFullyWalled.png";
+
+// Checkpoint 0 is the finish line.
+inline std::vector<Checkpoint> TrackCheckpoints() {
+    return {
+        {{450, 35},  {450, 150}},
+        {{719, 260}, {850, 260}},
+        {{850, 665}, {723, 665}},
+        {{523, 482}, {625, 517}},
+        {{409, 438}, {295, 413}},
+        {{160, 730}, {220, 815}},
+        {{138, 600}, {49, 600}},
+        {{138, 205}, {49, 205}}
+    };
+}
+
+struct Controls {
+    float acceleration; // 1 forward, -0.4 reverse.
+    float steering; // -1 left, +1 right.
+};
+
+// Discrete DQN actions: 0 forward, 1 reverse, 2 left, 3 right, 4 fwd+left, 5 fwd+right, 6 nothing.
+// Reverse is plain negative throttle (no braking hack).
+constexpr int ACTION_COUNT = 7;
+constexpr Controls ACTION_CONTROLS[ACTION_COUNT] = {
+    { 1.0f,  0.0f},
+    {-0.4f,  0.0f},
+    { 0.0f, -1.0f},
+    { 0.0f,  1.0f},
+    { 1.0f, -1.0f},
+    { 1.0f,  1.0f},
+    { 0.0f,  0.0f}
+};
+
+struct CarState {
+    Vector2 position = START_POSITION;
+    float angle = START_ANGLE;
+    float speed = 0.0f;
+};
+
+// Terrain backends. Fixed-step simulation moves at most MAX_SPEED * dt (5px at 60 Hz) per step,
+// inside the grid padding, so it reads unchecked; frame-time loops (replay, game) can move any
+// distance in a long frame and use the bounds-checked lookup.
+struct GridTerrain {
+    const SurfaceGrid& grid;
+    uint8_t SurfaceAt(int x, int y) const { return grid.At(x, y); }
+};
+
+struct CheckedGridTerrain {
+    const SurfaceGrid& grid;
+    uint8_t SurfaceAt(int x, int y) const { return grid.SafeAt(x, y); }
+};
+
+struct StepInfo {
+    Vector2 prevPosition;
+    float surfaceFriction; // under the car before the move.
+    bool hitWall; // bounced back to prevPosition.
+};
+
+// One physics step: throttle and friction, surface speed cap, speed-dependent steering,
+// integration, and wall bounce.
+template <class Physics = CarPhysics, class Terrain>
+StepInfo StepCarPhysics(const Terrain& terrain, CarState& car, Controls controls, float dt) {
+    StepInfo info;
+    info.prevPosition = car.position;
+
+    Vector2 position = car.position;
+    Vector2 velocity = {0, 0};
+    float angle = car.angle;
+    float speed = car.speed;
+
+    float surfaceFriction = SurfaceFriction(terrain.SurfaceAt((int)position.x, (int)position.y));
+
+    speed += controls.acceleration * Physics::ACCELERATION * dt;
+
+    float frictionToApply = Physics::FRICTION;
+    if (controls.acceleration == 0.0f) frictionToApply = Physics::FRICTION * surfaceFriction;
+
+    if (speed > 0) {
+        speed -= frictionToApply * dt;
+        if (speed < 0) speed = 0;
+    } else if (speed < 0) {
+        speed += frictionToApply * dt;
+        if (speed > 0) speed = 0;
+    }
+
+    float maxSpeedOnSurface = Physics::MAX_SPEED;
+    if (surfaceFriction > Physics::SLOW_SURFACE) maxSpeedOnSurface = Physics::MAX_SPEED * 0.5f;
+
+    if (speed > maxSpeedOnSurface) speed = maxSpeedOnSurface;
+    if (speed < -maxSpeedOnSurface * 0.5f) speed = -maxSpeedOnSurface * 0.5f;
+
+    float speedFactor = 1.0f / (1.0f + fabs(speed) / Physics::MAX_SPEED * Physics::TURN_SPEED_FACTOR);
+    float turnRate = Physics::TURN_SPEED_BASE * speedFactor;
+
+    if (fabs(speed) > 1.0f) angle += controls.steering * turnRate * dt * (speed / fabs(speed));
+
+    velocity.x = cos(angle) * speed;
+    velocity.y = sin(angle) * speed;
+
+    position.x += velocity.x * dt;
+    position.y += velocity.y * dt;
+
+// Walls and out-of-bounds both bounce the car back.
+    info.hitWall = IsSolid(terrain.SurfaceAt((int)position.x, (int)position.y));
+    if (info.hitWall) {
+        position = info.prevPosition;
+        speed *= Physics::WALL_BOUNCE;
+    }
+
+    car.position = position;
+    car.angle = angle;
+    car.speed = speed;
+    info.surfaceFriction = surfaceFriction;
+    return info;
+}
+
+struct RaceState {
+    int currentLap = -1; // -1/0 until the finish line is first crossed, then 1..TOTAL_LAPS.
+    int nextCheckpoint = 0;
+    bool finished = false;
+};
+
+// What AdvanceRace saw this step.
+struct RaceEvents {
+    bool lapStarted = false; // first finish-line crossing (lap 1 begins).
+    bool checkpoint = false; // expected intermediate checkpoint crossed.
+    bool lapCompleted = false; // finish line crossed with every checkpoint of the lap.
+    bool finished = false; // lapCompleted and that was the last lap.
+};
+
+// Checkpoint/lap rules. Only the expected checkpoint counts. crossed holds one flag per
+// checkpoint (checkpoint 0 = finish line) for the current lap.
+inline RaceEvents AdvanceRace(const std::vector<Checkpoint>& checkpoints, unsigned char* crossed,
+                              RaceState& race, Vector2 prevPosition, Vector2 position) {
+    RaceEvents events;
+    const int numCheckpoints = (int)checkpoints.size();
+    int& nextCheckpoint = race.nextCheckpoint;
+
+    const Checkpoint& cp = checkpoints[nextCheckpoint];
+    if (!cp.CheckCrossing(prevPosition, position)) return events;
+
+    if (nextCheckpoint == 0) {
+        if (race.currentLap > 0) {
+            bool allCrossed = true;
+            for (int c = 1; c < numCheckpoints; c++) {
+                if (!crossed[c]) { allCrossed = false; break; }
+            }
+
+            if (allCrossed) {
+                events.lapCompleted = true;
+                race.currentLap++;
+
+                for (int c = 0; c < numCheckpoints; c++) crossed[c] = 0;
+                nextCheckpoint = 1;
+
+                if (race.currentLap >= TOTAL_LAPS) {
+                    race.finished = true;
+                    events.finished = true;
+                }
+            } else {
+                crossed[0] = 0;
+            }
+        } else {
+            events.lapStarted = true;
+            race.currentLap = 1;
+            crossed[0] = 0;
+            nextCheckpoint = 1;
+        }
+    } else {
+        if (race.currentLap > 0) {
+            events.checkpoint = true;
+            crossed[nextCheckpoint] = 1;
+            nextCheckpoint = (nextCheckpoint + 1) % numCheckpoints;
+        } else {
+            crossed[nextCheckpoint] = 0;
+        }
+    }
+    return events;
+}
+
+// One car on the track with its race progress (EvaluateGreedy, replay, game).
+// VecEnv keeps the same state as struct-of-arrays and calls the free functions directly.
+template <class Terrain, class Physics = CarPhysics>
+class RacingSim {
+public:
+    RacingSim(const Terrain& terrain, const std::vector<Checkpoint>& checkpoints)
+        : terrain_(terrain), checkpoints_(checkpoints), crossed_(checkpoints.size(), 0) {}
+
+    void Reset() {
+        car_ = CarState();
+        race_ = RaceState();
+        events_ = RaceEvents();
+        std::fill(crossed_.begin(), crossed_.end(), 0);
+    }
+
+// Physics, then checkpoint rules (skipped once the race is finished).
+    StepInfo Step(Controls controls, float dt) {
+        StepInfo info = StepCarPhysics<Physics>(terrain_, car_, controls, dt);
+        events_ = race_.finished ? RaceEvents()
+                                 : AdvanceRace(checkpoints_, crossed_.data(), race_, info.prevPosition, car_.position);
+        return info;
+    }
+
+    StepInfo StepAction(int action, float dt) { return Step(ACTION_CONTROLS[action], dt); }
+
+// Observation from the current car state through any GetState track/sensor.
+    template <class Sensor>
+    void Observe(const Sensor& sensor, float* state) const {
+        GetState(sensor, car_.position, car_.angle, car_.speed, state);
+    }
+
+    CarState& car() { return car_; }
+    const CarState& car() const { return car_; }
+    const RaceState& race() const { return race_; }
+    const RaceEvents& events() const { return events_; }
+    const std::vector<Checkpoint>& checkpoints() const { return checkpoints_; }
+    bool Crossed(int c) const { return crossed_[c] != 0; }
+
+private:
+    Terrain terrain_;
+    std::vector<Checkpoint> checkpoints_;
+    std::vector<unsigned char> crossed_;
+    CarState car_;
+    RaceState race_;
+    RaceEvents events_;
+};
+
+#endif // RACING_SIM_H
@@ -1,82 +1,542 @@
-#ifndef REPLAY_BUFFER_H
-#define REPLAY_BUFFER_H
-
-#include <vector>
-#include <random>
-#include <algorithm>
-
-// Experience structure
-struct Experience {
-    std::vector<float> state;
-    int action;
-    float reward;
-    std::vector<float> next_state;
-    bool done;
-    
-    Experience(const std::vector<float>& s, int a, float r, 
-               const std::vector<float>& ns, bool d)
-        : state(s), action(a), reward(r), next_state(ns), done(d) {}
-};
-
-// Experience Replay Buffer
-class ReplayBuffer {
-public:
-    ReplayBuffer(int capacity) : capacity_(capacity) {
-        buffer_.reserve(capacity);
-    }
-    
-    // Add experience to buffer
-    void add(const std::vector<float>& state, int action, float reward,
-             const std::vector<float>& next_state, bool done) {
-        if (buffer_.size() >= capacity_) {
-            buffer_.erase(buffer_.begin());
-        }
-        buffer_.emplace_back(state, action, reward, next_state, done);
-    }
-    
-    // Sample random batch
-    void sample(int batch_size,
-                std::vector<std::vector<float>>& states,
-                std::vector<int>& actions,
-                std::vector<float>& rewards,
-                std::vector<std::vector<float>>& next_states,
-                std::vector<bool>& dones) {
-        
-        states.clear();
-        actions.clear();
-        rewards.clear();
-        next_states.clear();
-        dones.clear();
-        
-        states.reserve(batch_size);
-        actions.reserve(batch_size);
-        rewards.reserve(batch_size);
-        next_states.reserve(batch_size);
-        dones.reserve(batch_size);
-        
-        // Random sampling
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, buffer_.size() - 1);
-        
-        for (int i = 0; i < batch_size; i++) {
-            int idx = dis(gen);
-            const auto& exp = buffer_[idx];
-            
-            states.push_back(exp.state);
-            actions.push_back(exp.action);
-            rewards.push_back(exp.reward);
-            next_states.push_back(exp.next_state);
-            dones.push_back(exp.done);
-        }
-    }
-    
-    int size() const { return buffer_.size(); }
-    bool can_sample(int batch_size) const { return buffer_.size() >= batch_size; }
-    
-private:
-    int capacity_;
-    std::vector<Experience> buffer_;
-};
-
-#endif // REPLAY_BUFFER_H
\ No newline at end of file
+#ifndef REPLAY_BUFFER_H
+#define REPLAY_BUFFER_H
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <string>
+
+#include "sum_tree.h"
+#include "rng.h"
+#include "mapped_file.h"
+#include "observation_codec.h"
+
+// Destination of a sampled minibatch: caller-owned flat arrays of `size` rows (states and
+// next_states are row-major, size x state_size). The learner can point these straight at its
+// own persistent tensors, so sampling writes each row exactly once.
+struct ReplayBatchView {
+    int size = 0;
+    int* indices = nullptr; // buffer slots the rows came from.
+    float* states = nullptr;
+    int64_t* actions = nullptr;
+    float* rewards = nullptr;
+    float* next_states = nullptr;
+    float* dones = nullptr; // 0 or 1.
+    float* weights = nullptr; // importance-sampling weights (all 1 for uniform sampling).
+    float* steps = nullptr; // bootstrap horizon k: the target discounts next_state by gamma^k.
+};
+
+// Sampled minibatch in flat row-major arrays, reused between calls so steady-state
+// sampling does not allocate.
+struct ReplayBatch {
+    int size = 0;
+    int state_size = 0;
+    std::vector<int> indices; // buffer slots the rows came from.
+    std::vector<float> states; // size x state_size.
+    std::vector<int64_t> actions;
+    std::vector<float> rewards;
+    std::vector<float> next_states; // size x state_size.
+    std::vector<float> dones; // 0 or 1.
+    std::vector<float> weights; // importance-sampling weights (all 1 for uniform sampling).
+    std::vector<float> steps; // bootstrap horizon (1 unless added by an NStepBuilder).
+
+    void resize(int batch_size, int state_dim) {
+        size = batch_size;
+        state_size = state_dim;
+        indices.resize(batch_size);
+        states.resize((size_t)batch_size * state_dim);
+        actions.resize(batch_size);
+        rewards.resize(batch_size);
+        next_states.resize((size_t)batch_size * state_dim);
+        dones.resize(batch_size);
+        weights.resize(batch_size);
+        steps.resize(batch_size);
+    }
+
+    ReplayBatchView view() {
+        return { size, indices.data(), states.data(), actions.data(), rewards.data(),
+                 next_states.data(), dones.data(), weights.data(), steps.data() };
+    }
+};
+
+// How a ReplayBuffer stores observations.
+enum class ReplayStorage {
+    Pairs, // state and next_state copied per transition.
+    Frames, // each observation stored once; transitions reference rows of a shared frame ring.
+            // Needs consecutive transitions per stream (state == the stream's last next_state):
+            // otherwise each add writes two frames and the ring holds about half of capacity.
+    Mapped // Pairs as fixed-size records in a memory-mapped file (open_mapped).
+};
+
+// Mapped storage file: this header followed by the codec's per-feature lo and step (floats),
+// padded to MAPPED_HEADER_BYTES, then capacity records: encoded state, encoded next_state,
+// padding to 4 bytes, then action, reward, done and steps as floats.
+struct ReplayFileHeader {
+    char magic[8]; // "SRREPLAY"
+    uint32_t version;
+    int32_t state_size;
+    int64_t capacity;
+    int64_t record_bytes;
+    int64_t cursor; // next slot to write.
+    int64_t size;
+    int64_t added;
+    int32_t encoding; // ObservationEncoding.
+    int32_t reserved;
+};
+constexpr size_t MAPPED_HEADER_BYTES = 4096;
+constexpr uint32_t MAPPED_VERSION = 3;
+
+// Experience Replay Buffer
+// Fixed-capacity ring buffer, struct-of-arrays: every field lives in one contiguous array
+// allocated up front. Once full, add overwrites the oldest slot, so insert is O(1) and never
+// allocates; a sampled row is one contiguous state_size copy per state.
+//
+// Frames storage: the next_state of step t is the state of step t+1, so each stream (car)
+// writes its next_state as a new frame and the following transition reuses that frame as its
+// state. A state that does not match the stream's last frame (episode start after a reset)
+// gets a frame of its own. Frames live in a ring of frame_capacity rows (default capacity plus
+// 1/16 for episode starts); overwriting a frame first evicts every transition up to the
+// youngest one that still references it, so sampled rows are always intact.
+//
+// Prioritized sampling (enable_prioritized): transition i is drawn with probability
+// p_i / sum(p), p_i = (|td_error_i| + eps)^alpha, from a sum tree over the slots. New
+// transitions get the largest priority seen so far, so each is replayed at least once soon;
+// update_priorities refreshes the sampled slots from the learner's TD errors in one batch.
+//
+// Mapped storage keeps the transitions in a file instead of RAM, one fixed-size record per
+// slot, so the capacity is bounded by disk space (the file is sparse until written). The
+// header never counts a record being written (see AddRecord), so a killed process loses at
+// most the transition in flight (or, once full, the one it was overwriting), and reopening the
+// file resumes with every other stored transition. A random sample touches one record, i.e. at
+// most one page fault.
+//
+// Each transition also records its bootstrap horizon (steps): 1 for plain transitions, up to n
+// for n-step returns (n_step.h), where next_state is the state n steps later.
+//
+// Observation rows can be stored encoded (set_observation_codec: fp16, or uint16/uint8 over
+// each feature's range) in every storage; gather decodes them straight into the batch.
+class ReplayBuffer {
+public:
+    ReplayBuffer(int capacity, int state_size, ReplayStorage storage = ReplayStorage::Pairs,
+                 int frame_capacity = 0)
+        : capacity_(capacity),
+          state_size_(state_size),
+          storage_(storage),
+          actions_(storage == ReplayStorage::Mapped ? 0 : capacity),
+          rewards_(storage == ReplayStorage::Mapped ? 0 : capacity),
+          dones_(storage == ReplayStorage::Mapped ? 0 : capacity),
+          steps_(storage == ReplayStorage::Mapped ? 0 : capacity),
+          gen_(0, RNG_STREAM_REPLAY) {
+        if (storage_ == ReplayStorage::Frames) {
+            frame_capacity_ = (frame_capacity > 0) ? frame_capacity : capacity + capacity / 16 + 64;
+            frame_last_user_.assign(frame_capacity_, -1);
+            state_frame_.resize(capacity);
+            next_frame_.resize(capacity);
+        }
+        AllocateRows(ObservationCodec(ObservationEncoding::Float32, state_size));
+    }
+
+    // Stores observation rows through codec (codec.size() == state_size) from now on. Call
+    // before adding transitions (and before open_mapped).
+    void set_observation_codec(const ObservationCodec& codec) { AllocateRows(codec); }
+
+    const ObservationCodec& observation_codec() const { return codec_; }
+
+    // Switches sampling to proportional prioritization. Call before adding transitions.
+    void enable_prioritized(float alpha, float epsilon = 1e-6f) {
+        prioritized_ = true;
+        alpha_ = alpha;
+        priority_epsilon_ = epsilon;
+        max_priority_ = 1.0;
+        tree_.Reset(capacity_);
+        tree_indices_.reserve(1024);
+        tree_values_.reserve(1024);
+    }
+
+    bool prioritized() const { return prioritized_; }
+
+    // Mapped storage (required before the first add): opens the replay file at path, resuming
+    // its transitions, or creates it if missing. Fails (leaving the file untouched) if it was written with another capacity or
+    // state size. Call after enable_prioritized; resumed transitions start at max priority.
+    bool open_mapped(const std::string& path) {
+        if (storage_ != ReplayStorage::Mapped) return false;
+        const size_t rangeBytes = (size_t)state_size_ * sizeof(float);
+        if (sizeof(ReplayFileHeader) + 2 * rangeBytes > MAPPED_HEADER_BYTES) return false;
+        const size_t bytes = MAPPED_HEADER_BYTES + (size_t)capacity_ * record_bytes_;
+
+        if (file_.OpenReadWrite(path)) {
+            const ReplayFileHeader* header = (const ReplayFileHeader*)file_.data();
+            const char* ranges = (const char*)file_.data() + sizeof(ReplayFileHeader);
+            if (file_.size() != bytes || std::memcmp(header->magic, "SRREPLAY", 8) != 0 ||
+                header->version != MAPPED_VERSION || header->state_size != state_size_ ||
+                header->capacity != capacity_ || header->record_bytes != (int64_t)record_bytes_ ||
+                header->encoding != (int32_t)codec_.encoding() ||
+                std::memcmp(ranges, codec_.lo(), rangeBytes) != 0 ||
+                std::memcmp(ranges + rangeBytes, codec_.step(), rangeBytes) != 0) {
+                file_.Close();
+                return false;
+            }
+        } else {
+            if (!file_.Create(path, bytes)) return false;
+            ReplayFileHeader* header = (ReplayFileHeader*)file_.data();
+            std::memcpy(header->magic, "SRREPLAY", 8);
+            header->version = MAPPED_VERSION;
+            header->state_size = state_size_;
+            header->capacity = capacity_;
+            header->record_bytes = (int64_t)record_bytes_;
+            header->cursor = 0;
+            header->size = 0;
+            header->added = 0;
+            header->encoding = (int32_t)codec_.encoding();
+            header->reserved = 0;
+            char* ranges = (char*)file_.data() + sizeof(ReplayFileHeader);
+            std::memcpy(ranges, codec_.lo(), rangeBytes);
+            std::memcpy(ranges + rangeBytes, codec_.step(), rangeBytes);
+        }
+
+        header_ = (ReplayFileHeader*)file_.data();
+        records_ = (uint8_t*)file_.data() + MAPPED_HEADER_BYTES;
+        cursor_ = (int)header_->cursor;
+        size_ = (int)header_->size;
+        added_ = header_->added;
+// Resumed transitions are the size_ slots ending before the cursor, which wrap past the end of
+// the ring once it has been full; every other slot keeps priority 0 and is never drawn.
+        if (prioritized_) {
+            const int oldest = Oldest();
+            const int end = oldest + size_;
+            if (end <= capacity_) {
+                tree_.Fill(oldest, end, max_priority_);
+            } else {
+                tree_.Fill(oldest, capacity_, max_priority_);
+                tree_.Fill(0, end - capacity_, max_priority_);
+            }
+        }
+        return true;
+    }
+
+    // Forces a mapped buffer's pages to disk (they survive a process exit without this).
+    bool flush() { return file_.isOpen() && file_.Sync(); }
+
+    // Add experience to buffer (state and next_state point at state_size floats).
+    // stream identifies the car the transition belongs to (Frames storage chains its frames);
+    // steps is the bootstrap horizon (1..255) of an n-step transition.
+    void add(const float* state, int action, float reward, const float* next_state, bool done,
+             int stream = 0, int steps = 1) {
+        if (storage_ == ReplayStorage::Pairs) {
+            const size_t row = (size_t)cursor_ * row_bytes_;
+            codec_.Encode(state, &states_[row]);
+            codec_.Encode(next_state, &next_states_[row]);
+        } else if (storage_ == ReplayStorage::Mapped) {
+            AddRecord(state, action, reward, next_state, done, steps);
+            return;
+        } else {
+            AddFrames(state, next_state, stream);
+        }
+        actions_[cursor_] = action;
+        rewards_[cursor_] = reward;
+        dones_[cursor_] = done ? 1 : 0;
+        steps_[cursor_] = (uint8_t)steps;
+        if (prioritized_) tree_.Set(cursor_, max_priority_);
+        Advance();
+    }
+
+    void add(const std::vector<float>& state, int action, float reward,
+             const std::vector<float>& next_state, bool done) {
+        add(state.data(), action, reward, next_state.data(), done);
+    }
+
+    // Seeds the buffer's own sampling generator (see rng.h for streams).
+    void seed(uint64_t seed, uint64_t stream = RNG_STREAM_REPLAY) { gen_.Seed(seed, stream); }
+
+    // Sample random batch (with replacement). Uniform, or proportional to priority with
+    // importance-sampling weights (size * P(i))^-beta scaled so the batch maximum is 1.
+    void sample(int batch_size, ReplayBatch& batch, float beta = 1.0f) {
+        batch.resize(batch_size, state_size_);
+        sample(batch.view(), beta, gen_);
+    }
+
+    // Same, into caller-owned arrays of batch.size rows.
+    void sample(const ReplayBatchView& batch, float beta = 1.0f) { sample(batch, beta, gen_); }
+
+    // Same, drawing from the caller's generator (one per sampling thread).
+    void sample(const ReplayBatchView& batch, float beta, Rng& rng) {
+        if (prioritized_) {
+            SamplePrioritized(batch, beta, rng);
+        } else {
+            const int oldest = Oldest();
+            for (int i = 0; i < batch.size; i++) {
+                int slot = oldest + (int)rng.NextInt((uint32_t)size_);
+                batch.indices[i] = (slot >= capacity_) ? slot - capacity_ : slot;
+                batch.weights[i] = 1.0f;
+            }
+        }
+        gather(batch);
+    }
+
+    // New priorities for sampled slots from their TD errors (one sum-tree batch update).
+    // generation is added() when the batch was sampled (-1: nothing added since). A batch
+    // trained on later (prefetched, async learner) may name slots an add has overwritten since,
+    // or that frame eviction dropped; those are skipped, so a stale TD error never lands on
+    // another transition or revives an evicted one.
+    void update_priorities(const int* indices, const float* td_errors, int count, int64_t generation = -1) {
+        if (!prioritized_) return;
+        const int64_t written = (generation < 0) ? 0 : added_ - generation;
+        tree_indices_.clear();
+        tree_values_.clear();
+        for (int k = 0; k < count; k++) {
+            const int slot = indices[k];
+            if (!stored(slot) || WrittenSince(slot, written)) continue;
+            double priority = std::pow((double)std::fabs(td_errors[k]) + priority_epsilon_, (double)alpha_);
+            max_priority_ = std::max(max_priority_, priority);
+            tree_indices_.push_back(slot);
+            tree_values_.push_back(priority);
+        }
+        tree_.SetBatch(tree_indices_.data(), tree_values_.data(), (int)tree_indices_.size());
+    }
+
+    // Fills batch rows from batch.indices (also the entry point for non-uniform samplers).
+    void gather(const ReplayBatchView& batch) const {
+        const int n = batch.size;
+        if (storage_ == ReplayStorage::Mapped) {
+            for (int i = 0; i < n; i++) {
+                const uint8_t* record = &records_[(size_t)batch.indices[i] * record_bytes_];
+                codec_.Decode(record, &batch.states[(size_t)i * state_size_]);
+                codec_.Decode(record + row_bytes_, &batch.next_states[(size_t)i * state_size_]);
+                const float* tail = (const float*)(record + record_tail_);
+                batch.actions[i] = (int64_t)tail[0];
+                batch.rewards[i] = tail[1];
+                batch.dones[i] = tail[2];
+                if (batch.steps) batch.steps[i] = tail[3];
+            }
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            const int idx = batch.indices[i];
+            codec_.Decode(StateRow(idx), &batch.states[(size_t)i * state_size_]);
+            codec_.Decode(NextStateRow(idx), &batch.next_states[(size_t)i * state_size_]);
+        }
+        for (int i = 0; i < n; i++) {
+            const int idx = batch.indices[i];
+            batch.actions[i] = actions_[idx];
+            batch.rewards[i] = rewards_[idx];
+            batch.dones[i] = (float)dones_[idx];
+        }
+        if (batch.steps) {
+            for (int i = 0; i < n; i++) batch.steps[i] = (float)steps_[batch.indices[i]];
+        }
+    }
+
+    // Encoded rows (row_bytes() each) of the transition in slot idx.
+    const uint8_t* StateRow(int idx) const {
+        if (storage_ == ReplayStorage::Pairs) return &states_[(size_t)idx * row_bytes_];
+        if (storage_ == ReplayStorage::Mapped) return &records_[(size_t)idx * record_bytes_];
+        return &frames_[(size_t)state_frame_[idx] * row_bytes_];
+    }
+    const uint8_t* NextStateRow(int idx) const {
+        if (storage_ == ReplayStorage::Pairs) return &next_states_[(size_t)idx * row_bytes_];
+        if (storage_ == ReplayStorage::Mapped) return &records_[(size_t)idx * record_bytes_ + row_bytes_];
+        return &frames_[(size_t)next_frame_[idx] * row_bytes_];
+    }
+
+    int row_bytes() const { return (int)row_bytes_; }
+
+    int size() const { return size_; }
+    int capacity() const { return capacity_; }
+    int64_t added() const { return added_; } // transitions ever added (the batch generation).
+    int state_size() const { return state_size_; }
+    ReplayStorage storage() const { return storage_; }
+    bool can_sample(int batch_size) const { return size_ >= batch_size; }
+
+    // True if slot holds a stored transition, i.e. lies in the window of size() slots from the
+    // oldest one.
+    bool stored(int slot) const {
+        int offset = slot - Oldest();
+        if (offset < 0) offset += capacity_;
+        return offset < size_;
+    }
+
+    // Sampling priority of a slot (0 when not stored or not prioritized).
+    double priority(int slot) const { return prioritized_ ? tree_.Get(slot) : 0.0; }
+
+    // Resident buffers only; a mapped buffer's records are in the file (page cache).
+    size_t Bytes() const {
+        return states_.size() + next_states_.size() + frames_.size() + rewards_.size() * sizeof(float) +
+               (actions_.size() + state_frame_.size() + next_frame_.size()) * sizeof(int) +
+               frame_last_user_.size() * sizeof(int64_t) + dones_.size() + steps_.size() + tree_.Bytes();
+    }
+
+private:
+    void AllocateRows(const ObservationCodec& codec) {
+        codec_ = codec;
+        row_bytes_ = codec.RowBytes();
+        encoded_.resize(row_bytes_);
+// Assigned from fresh vectors so a smaller encoding actually returns the memory.
+        if (storage_ == ReplayStorage::Pairs) {
+            states_ = std::vector<uint8_t>((size_t)capacity_ * row_bytes_);
+            next_states_ = std::vector<uint8_t>((size_t)capacity_ * row_bytes_);
+        } else if (storage_ == ReplayStorage::Frames) {
+            frames_ = std::vector<uint8_t>((size_t)frame_capacity_ * row_bytes_);
+        } else {
+            record_tail_ = (2 * row_bytes_ + 3) & ~(size_t)3;
+            record_bytes_ = record_tail_ + 4 * sizeof(float);
+        }
+    }
+
+    // Slot of the oldest stored transition.
+    int Oldest() const {
+        int slot = cursor_ - size_;
+        return (slot < 0) ? slot + capacity_ : slot;
+    }
+
+    // True if slot is among the last `written` slots written (the ones before cursor_).
+    bool WrittenSince(int slot, int64_t written) const {
+        if (written >= capacity_) return true;
+        int back = cursor_ - 1 - slot;
+        if (back < 0) back += capacity_;
+        return back < written;
+    }
+
+// Stratified proportional sampling: one draw from each of batch_size equal slices of the
+// total priority mass.
+    void SamplePrioritized(const ReplayBatchView& batch, float beta, Rng& rng) {
+        const int n = batch.size;
+        const double total = tree_.Total();
+        const double segment = total / n;
+
+        float maxWeight = 0.0f;
+        for (int i = 0; i < n; i++) {
+            double mass = std::min((i + rng.NextDouble()) * segment, total * (1.0 - 1e-12));
+            int slot = tree_.Find(mass);
+            double probability = tree_.Get(slot) / total;
+            float weight = (float)std::pow((double)size_ * probability, -(double)beta);
+            batch.indices[i] = slot;
+            batch.weights[i] = weight;
+            maxWeight = std::max(maxWeight, weight);
+        }
+        for (int i = 0; i < n; i++) batch.weights[i] /= maxWeight;
+    }
+
+    void Advance() {
+        cursor_ = (cursor_ + 1 == capacity_) ? 0 : cursor_ + 1;
+        if (size_ < capacity_) size_++;
+        added_++;
+    }
+
+// The header never counts a half-written record, so a process killed mid-add loses at most that
+// transition. While filling, the slot is past size; once full it is the oldest stored one, so
+// size first drops by one (the oldest position moves past the slot), then the record is
+// written, then cursor, size and added are published. The signal fences keep the compiler from
+// moving stores across those steps.
+    void AddRecord(const float* state, int action, float reward, const float* next_state, bool done, int steps) {
+        if (size_ == capacity_) {
+            header_->size = capacity_ - 1;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+        uint8_t* record = &records_[(size_t)cursor_ * record_bytes_];
+        codec_.Encode(state, record);
+        codec_.Encode(next_state, record + row_bytes_);
+        float* tail = (float*)(record + record_tail_);
+        tail[0] = (float)action;
+        tail[1] = reward;
+        tail[2] = done ? 1.0f : 0.0f;
+        tail[3] = (float)steps;
+        if (prioritized_) tree_.Set(cursor_, max_priority_);
+        Advance();
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        header_->cursor = cursor_;
+        header_->size = size_;
+        header_->added = added_;
+    }
+
+    void AddFrames(const float* state, const float* next_state, int stream) {
+        if (stream >= (int)stream_frame_.size()) stream_frame_.resize(stream + 1, -1);
+
+// Continuing episode: state is the frame this stream wrote as its last next_state. If that
+// frame is the next one to be recycled it is written again (same row, evicting its old users).
+// Rows are compared encoded, so a state that encodes the same reuses the frame.
+        codec_.Encode(state, encoded_.data());
+        int stateFrame = stream_frame_[stream];
+        if (stateFrame < 0 || stateFrame == frame_cursor_ ||
+            std::memcmp(&frames_[(size_t)stateFrame * row_bytes_], encoded_.data(), row_bytes_) != 0) {
+            stateFrame = WriteFrame(encoded_.data());
+        }
+        frame_last_user_[stateFrame] = added_;
+        codec_.Encode(next_state, encoded_.data());
+        const int nextFrame = WriteFrame(encoded_.data());
+        frame_last_user_[nextFrame] = added_;
+
+        state_frame_[cursor_] = stateFrame;
+        next_frame_[cursor_] = nextFrame;
+        stream_frame_[stream] = nextFrame;
+    }
+
+    // Copies an encoded row into the oldest frame, evicting the transitions that still use it.
+    int WriteFrame(const uint8_t* row) {
+        const int frame = frame_cursor_;
+        frame_cursor_ = (frame_cursor_ + 1 == frame_capacity_) ? 0 : frame_cursor_ + 1;
+
+        const int64_t lastUser = frame_last_user_[frame];
+        const int64_t oldest = added_ - size_;
+        if (lastUser >= oldest) {
+            const int evicted = (int)(lastUser + 1 - oldest);
+            if (prioritized_) {
+                int slot = Oldest();
+                for (int k = 0; k < evicted; k++) {
+                    tree_.Set(slot, 0.0);
+                    slot = (slot + 1 == capacity_) ? 0 : slot + 1;
+                }
+            }
+            size_ -= evicted;
+        }
+        frame_last_user_[frame] = -1;
+
+        std::memcpy(&frames_[(size_t)frame * row_bytes_], row, row_bytes_);
+        return frame;
+    }
+
+    int capacity_;
+    int state_size_;
+    ReplayStorage storage_;
+    int cursor_ = 0; // next slot to write (the oldest one once full).
+    int size_ = 0;
+    int64_t added_ = 0; // transitions ever added; the one in slot cursor_ - 1 is added_ - 1.
+
+    ObservationCodec codec_;
+    size_t row_bytes_ = 0; // encoded observation row.
+    std::vector<uint8_t> encoded_; // one encoded row, Frames scratch.
+    std::vector<uint8_t> states_; // Pairs.
+    std::vector<uint8_t> next_states_; // Pairs.
+    std::vector<int> actions_;
+    std::vector<float> rewards_;
+    std::vector<uint8_t> dones_;
+    std::vector<uint8_t> steps_;
+
+    int frame_capacity_ = 0; // Frames.
+    int frame_cursor_ = 0;
+    std::vector<uint8_t> frames_;
+    std::vector<int64_t> frame_last_user_; // youngest transition using the frame, -1 if free.
+    std::vector<int> state_frame_;
+    std::vector<int> next_frame_;
+    std::vector<int> stream_frame_; // last next_state frame per stream.
+
+    MappedFile file_; // Mapped.
+    ReplayFileHeader* header_ = nullptr;
+    uint8_t* records_ = nullptr;
+    size_t record_bytes_ = 0;
+    size_t record_tail_ = 0; // offset of action, reward, done, steps (floats).
+
+    bool prioritized_ = false;
+    float alpha_ = 0.6f;
+    float priority_epsilon_ = 1e-6f;
+    double max_priority_ = 1.0;
+    SumTree tree_; // priority^alpha per slot, 0 for empty or evicted slots.
+    std::vector<int> tree_indices_; // update_priorities scratch.
+    std::vector<double> tree_values_;
+
+    Rng gen_;
+};
+
+#endif // REPLAY_BUFFER_H
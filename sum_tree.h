@@ -0,0 +1,91 @@
+#ifndef SUM_TREE_H
+#define SUM_TREE_H
+
+#include <vector>
+#include <algorithm>
+
+// Binary sum tree over `capacity` non-negative leaf values, stored implicitly in one array:
+// node 1 is the root, node n has children 2n and 2n+1, leaves start at node `leaves_`
+// (capacity rounded up to a power of two, so every leaf is at the same depth).
+// Set, Find and Total are O(log n); SetBatch updates many leaves and recomputes each shared
+// ancestor only once. Sums are kept in double so millions of small priorities do not drift.
+class SumTree {
+public:
+    SumTree() = default;
+
+    explicit SumTree(int capacity) { Reset(capacity); }
+
+    void Reset(int capacity) {
+        capacity_ = capacity;
+        leaves_ = 1;
+        while (leaves_ < capacity) leaves_ *= 2;
+        nodes_.assign((size_t)2 * leaves_, 0.0);
+    }
+
+    int capacity() const { return capacity_; }
+    double Total() const { return nodes_[1]; }
+    double Get(int i) const { return nodes_[(size_t)leaves_ + i]; }
+
+    void Set(int i, double value) {
+        size_t node = (size_t)leaves_ + i;
+        nodes_[node] = value;
+        for (node /= 2; node >= 1; node /= 2) nodes_[node] = nodes_[2 * node] + nodes_[2 * node + 1];
+    }
+
+// Sets count leaves, then recomputes the touched ancestors level by level. Parents of a sorted
+// node list are sorted too, so duplicates are adjacent and one pass removes them.
+    void SetBatch(const int* indices, const double* values, int count) {
+        if (count <= 0) return;
+        pending_.resize(count);
+        for (int k = 0; k < count; k++) {
+            size_t node = (size_t)leaves_ + indices[k];
+            nodes_[node] = values[k];
+            pending_[k] = node;
+        }
+        std::sort(pending_.begin(), pending_.end());
+
+        size_t n = pending_.size();
+        while (pending_[0] > 1) {
+            size_t out = 0;
+            for (size_t k = 0; k < n; k++) {
+                size_t parent = pending_[k] / 2;
+                if (out > 0 && pending_[out - 1] == parent) continue;
+                nodes_[parent] = nodes_[2 * parent] + nodes_[2 * parent + 1];
+                pending_[out++] = parent;
+            }
+            n = out;
+        }
+    }
+
+// Sets leaves [begin, end) to value and rebuilds every internal node in one O(n) pass.
+    void Fill(int begin, int end, double value) {
+        for (int i = begin; i < end; i++) nodes_[(size_t)leaves_ + i] = value;
+        for (size_t node = (size_t)leaves_ - 1; node >= 1; node--) nodes_[node] = nodes_[2 * node] + nodes_[2 * node + 1];
+    }
+
+// Leaf whose cumulative range contains mass (0 <= mass < Total()). Never returns a zero leaf
+// while Total() > 0, even when rounding puts mass at the very end of the range.
+    int Find(double mass) const {
+        size_t node = 1;
+        while (node < (size_t)leaves_) {
+            size_t left = 2 * node;
+            if (mass < nodes_[left] || nodes_[left + 1] <= 0.0) {
+                node = left;
+            } else {
+                mass -= nodes_[left];
+                node = left + 1;
+            }
+        }
+        return (int)(node - leaves_);
+    }
+
+    size_t Bytes() const { return nodes_.size() * sizeof(double); }
+
+private:
+    int capacity_ = 0;
+    int leaves_ = 1;
+    std::vector<double> nodes_;
+    std::vector<size_t> pending_; // SetBatch scratch, reused.
+};
+
+#endif // SUM_TREE_H
@@ -0,0 +1,107 @@
+#ifndef SURFACE_GRID_H
+#define SURFACE_GRID_H
+
+#include "raylib.h"
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+// Track pixel helpers
+inline bool IsWall(Color color)  { return (color.r == 15 && color.g == 15 && color.b == 15); }
+inline bool IsTrack(Color color) { return (color.r == 35 && color.g == 35 && color.b == 35); }
+inline bool IsGrass(Color color) { return (color.r == 34 && color.g == 177 && color.b == 76); }
+
+inline float GetFrictionMultiplier(Color color) {
+    if (IsWall(color))  return 999.0f;
+    if (IsGrass(color)) return 3.0f;
+    if (IsTrack(color)) return 1.0f;
+    return 1.0f;
+}
+
+// Surface class per pixel. Anything that is not wall or grass behaves like track.
+// Wall and out-of-bounds are ordered last so "solid" is a single compare.
+enum SurfaceClass : uint8_t {
+    SURFACE_TRACK = 0,
+    SURFACE_GRASS = 1,
+    SURFACE_WALL  = 2,
+    SURFACE_OUT   = 3
+};
+
+// Friction multiplier per class. Out-of-bounds keeps the old default of 1.0.
+inline float SurfaceFriction(uint8_t surface) {
+    static const float kFriction[4] = { 1.0f, 3.0f, 999.0f, 1.0f };
+    return kFriction[surface];
+}
+
+inline bool IsSolid(uint8_t surface) { return surface >= SURFACE_WALL; }
+
+inline uint8_t ClassifySurface(Color color) {
+    if (IsWall(color))  return SURFACE_WALL;
+    if (IsGrass(color)) return SURFACE_GRASS;
+    return SURFACE_TRACK;
+}
+
+// Track image baked into one byte per pixel, surrounded by PAD cells of SURFACE_OUT.
+// The border is wider than a car moves in one step (5px) and than the 2px ray step,
+// so lookups one step past the image edge need no bounds check.
+struct SurfaceGrid {
+    static constexpr int PAD = 8;
+    static constexpr int GATHER_SLACK = 4; // bytes after the last cell for 32-bit SIMD gathers.
+
+    int width = 0;
+    int height = 0;
+    int stride = 0; // width + 2 * PAD.
+    std::vector<uint8_t> cells;
+
+// x, y in [-PAD, width + PAD) x [-PAD, height + PAD).
+    uint8_t At(int x, int y) const { return cells[(size_t)(y + PAD) * stride + (x + PAD)]; }
+
+    bool SolidAt(int x, int y) const { return IsSolid(At(x, y)); }
+
+// Bounds-checked lookup for callers whose per-step movement is not bounded
+// (frame-time physics in the replay and game loops).
+    uint8_t SafeAt(int x, int y) const {
+        if (x < -PAD || x >= width + PAD || y < -PAD || y >= height + PAD) return SURFACE_OUT;
+        return At(x, y);
+    }
+};
+
+inline SurfaceGrid BakeSurfaceGrid(const Image& trackImage) {
+    SurfaceGrid grid;
+    grid.width = trackImage.width;
+    grid.height = trackImage.height;
+    grid.stride = trackImage.width + 2 * SurfaceGrid::PAD;
+    grid.cells.assign((size_t)grid.stride * (trackImage.height + 2 * SurfaceGrid::PAD) + SurfaceGrid::GATHER_SLACK,
+                      SURFACE_OUT);
+
+    for (int y = 0; y < trackImage.height; y++) {
+        for (int x = 0; x < trackImage.width; x++) {
+            Color c = GetImageColor(trackImage, x, y);
+            grid.cells[(size_t)(y + SurfaceGrid::PAD) * grid.stride + (x + SurfaceGrid::PAD)] = ClassifySurface(c);
+        }
+    }
+    return grid;
+}
+
+// LIDAR ray cast over the surface grid (same 2px march as the image version).
+inline float CastLIDARRay(const SurfaceGrid& grid, Vector2 position, float angle, float maxDistance) {
+    float distance = 0.0f;
+    const float step = 2.0f;
+
+    const auto cosA = cos(angle);
+    const auto sinA = sin(angle);
+
+    while (distance < maxDistance) {
+        float checkX = position.x + cosA * distance;
+        float checkY = position.y + sinA * distance;
+
+        if (IsSolid(grid.At((int)checkX, (int)checkY))) return distance;
+
+        distance += step;
+    }
+
+    return maxDistance;
+}
+
+#endif // SURFACE_GRID_H
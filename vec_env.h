@@ -0,0 +1,275 @@
+#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+#include "racing_env.h"
+#include "racing_sim.h"
+#include "surface_grid.h"
+#include "lidar.h"
+#include "lidar_simd.h"
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+// Vectorized racing environment: N cars stepped in lockstep.
+// Car state is stored as struct-of-arrays so a step walks contiguous memory, and
+// observations live in one [N x STATE_SIZE] block. Physics, wall bounce, checkpoint
+// and lap rules come from racing_sim.h (shared with evaluation, replay and the game);
+// the reward shaping here is training-only. N = 1 reproduces the old trainer bit-for-bit.
+class VecEnv {
+public:
+    static constexpr int STATE_SIZE = OBSERVATION_SIZE;
+
+// Per-car result of the last Step().
+    struct StepResult {
+        float reward = 0.0f;
+        bool done = false; // terminal flag stored in replay (finish or time limit).
+        bool episodeOver = false; // car was reset after this step (done or stuck-break).
+        int episodeSteps = 0; // steps taken in the episode, including this one.
+    };
+
+// Summary of the episode a car just finished (valid when episodeOver is set).
+    struct EpisodeInfo {
+        float reward = 0.0f;
+        int steps = 0;
+        int laps = -1;
+        bool finished = false;
+        bool stuck = false;
+    };
+
+    VecEnv(const SurfaceGrid& trackGrid, const LidarSensor& lidar,
+           const std::vector<Checkpoint>& checkpoints,
+           int numEnvs, int maxSteps, float dt)
+        : trackGrid_(trackGrid),
+          lidar_(lidar),
+          checkpoints_(checkpoints),
+          numEnvs_(numEnvs),
+          numCheckpoints_((int)checkpoints.size()),
+          maxSteps_(maxSteps),
+          dt_(dt),
+          posX_(numEnvs), posY_(numEnvs),
+          angle_(numEnvs), speed_(numEnvs),
+          race_(numEnvs),
+          crossed_((size_t)numEnvs * checkpoints.size()),
+          episodeSteps_(numEnvs), episodeReward_(numEnvs),
+          stuckCounter_(numEnvs), lastCheckX_(numEnvs), lastCheckY_(numEnvs),
+          idleCounter_(numEnvs),
+          obs_((size_t)numEnvs * STATE_SIZE),
+          prevObs_((size_t)numEnvs * STATE_SIZE),
+          nextObs_((size_t)numEnvs * STATE_SIZE),
+          results_(numEnvs),
+          episodes_(numEnvs) {
+        for (int i = 0; i < numEnvs_; i++) ResetCar(i);
+    }
+
+    int NumEnvs() const { return numEnvs_; }
+
+// Observation each car should act on next, [N x STATE_SIZE].
+    const float* Observations() const { return obs_.data(); }
+    const float* Observation(int i) const { return &obs_[(size_t)i * STATE_SIZE]; }
+
+// Observation the last action was taken from, and the state it led to (pre auto-reset).
+    const float* PrevObservation(int i) const { return &prevObs_[(size_t)i * STATE_SIZE]; }
+    const float* NextObservation(int i) const { return &nextObs_[(size_t)i * STATE_SIZE]; }
+
+    const StepResult& Result(int i) const { return results_[i]; }
+    const EpisodeInfo& LastEpisode(int i) const { return episodes_[i]; }
+
+    void ResetCar(int i) {
+        const CarState start;
+        posX_[i] = start.position.x;
+        posY_[i] = start.position.y;
+        angle_[i] = start.angle;
+        speed_[i] = start.speed;
+
+        race_[i] = RaceState();
+        for (int c = 0; c < numCheckpoints_; c++) Crossed(i, c) = 0;
+
+        episodeSteps_[i] = 0;
+        episodeReward_[i] = 0.0f;
+
+        stuckCounter_[i] = 0;
+        lastCheckX_[i] = posX_[i];
+        lastCheckY_[i] = posY_[i];
+        idleCounter_[i] = 0;
+
+        WriteState(i, &obs_[(size_t)i * STATE_SIZE]);
+    }
+
+// Advance every car by one step. actions has NumEnvs() entries.
+// Cars whose episode ended are reset in place; their Observation() is the new start state.
+    void Step(const int* actions) {
+        std::swap(prevObs_, obs_);
+
+        for (int i = 0; i < numEnvs_; i++) StepCar(i, actions[i]);
+
+        WriteStates(nextObs_.data());
+
+        for (int i = 0; i < numEnvs_; i++) {
+            float* next = &nextObs_[(size_t)i * STATE_SIZE];
+            float* obs = &obs_[(size_t)i * STATE_SIZE];
+            if (results_[i].episodeOver) {
+                ResetCar(i);
+            } else {
+                std::memcpy(obs, next, sizeof(float) * STATE_SIZE);
+            }
+        }
+    }
+
+private:
+    static constexpr float V_IDLE = 8.0f;
+    static constexpr int IDLE_GRACE_FRAMES = 30;
+    static constexpr float IDLE_PENALTY = 0.02f;
+
+    static constexpr int STUCK_CHECK_INTERVAL = 75;
+    static constexpr float STUCK_DIST_THRESHOLD = 30.0f;
+    static constexpr int STUCK_STRIKES_MAX = 3;
+    static constexpr float STUCK_BREAK_PENALTY = 50.0f;
+
+    unsigned char& Crossed(int i, int c) { return crossed_[(size_t)i * numCheckpoints_ + c]; }
+
+    void WriteState(int i, float* out) const {
+        GetState(lidar_, {posX_[i], posY_[i]}, angle_[i], speed_[i], out);
+    }
+
+// Observations for every car into out [N x STATE_SIZE]; in Batch mode all cars'
+// rays go through one SIMD cast.
+    void WriteStates(float* out) {
+        if (lidar_.mode() == LidarMode::Batch) {
+            lidarBatch_.ComputeStates(lidar_.grid(), posX_.data(), posY_.data(),
+                                      angle_.data(), speed_.data(), numEnvs_, out);
+            return;
+        }
+        for (int i = 0; i < numEnvs_; i++) WriteState(i, out + (size_t)i * STATE_SIZE);
+    }
+
+    void StepCar(int i, int action) {
+        const float DT = dt_;
+        CarState car;
+        car.position = {posX_[i], posY_[i]};
+        car.angle = angle_[i];
+        car.speed = speed_[i];
+
+        StepInfo info = StepCarPhysics(GridTerrain{trackGrid_}, car, ACTION_CONTROLS[action], DT);
+        const Vector2 prevPosition = info.prevPosition;
+        const Vector2 position = car.position;
+        const float speed = car.speed;
+        const float surfaceFriction = info.surfaceFriction;
+        const bool hitWall = info.hitWall;
+
+        float reward = 0.0f;
+        RaceState& race = race_[i];
+
+        float distToNextCP = DistToCheckpointMid(checkpoints_, race.nextCheckpoint, position);
+        float prevDistToNextCP = DistToCheckpointMid(checkpoints_, race.nextCheckpoint, prevPosition);
+        float progress = prevDistToNextCP - distToNextCP;
+        reward += progress * 0.1f;
+
+        if (progress > 0.0f){
+            reward += fabs(speed) * DT * 0.0075f;
+        }
+
+        if (hitWall) reward -= 10.0f;
+        if (surfaceFriction > CarPhysics::SLOW_SURFACE) reward -= 2.0f * DT;
+
+        reward -= 0.005f;
+
+        if (fabs(speed) < V_IDLE && progress <= 0.0f) {
+            idleCounter_[i]++;
+            if (idleCounter_[i] > IDLE_GRACE_FRAMES) reward -= IDLE_PENALTY;
+        } else {
+            idleCounter_[i] = 0;
+        }
+
+        RaceEvents events = AdvanceRace(checkpoints_, &Crossed(i, 0), race, prevPosition, position);
+        if (events.checkpoint) reward += 50.0f;
+        if (events.lapCompleted) {
+            reward += 50.0f;
+            reward += 200.0f;
+        }
+        if (events.finished) reward += 500.0f;
+
+        if (race.nextCheckpoint != 0) {
+            const Checkpoint& finishLine = checkpoints_[0];
+            if (finishLine.CheckCrossing(prevPosition, position)) reward -= 10.0f;
+        }
+
+        posX_[i] = position.x;
+        posY_[i] = position.y;
+        angle_[i] = car.angle;
+        speed_[i] = speed;
+
+        episodeReward_[i] += reward;
+        episodeSteps_[i]++;
+
+        StepResult& r = results_[i];
+        r.reward = reward;
+        r.done = race.finished || episodeSteps_[i] >= maxSteps_;
+        r.episodeOver = r.done;
+        r.episodeSteps = episodeSteps_[i];
+
+        bool stuck = false;
+// Stuck check runs where the single-car loop ran it: before the next action.
+        if (!r.done && episodeSteps_[i] % STUCK_CHECK_INTERVAL == 0) {
+            float dx = posX_[i] - lastCheckX_[i];
+            float dy = posY_[i] - lastCheckY_[i];
+            float distMoved = sqrtf(dx*dx + dy*dy);
+
+            if (distMoved < STUCK_DIST_THRESHOLD) {
+                stuckCounter_[i]++;
+                if (stuckCounter_[i] >= STUCK_STRIKES_MAX) {
+                    episodeReward_[i] -= STUCK_BREAK_PENALTY;
+                    stuck = true;
+                    r.episodeOver = true;
+                }
+            } else {
+                stuckCounter_[i] = 0;
+            }
+            lastCheckX_[i] = posX_[i];
+            lastCheckY_[i] = posY_[i];
+        }
+
+        if (r.episodeOver) {
+            EpisodeInfo& e = episodes_[i];
+            e.reward = episodeReward_[i];
+            e.steps = episodeSteps_[i];
+            e.laps = race.currentLap;
+            e.finished = race.finished;
+            e.stuck = stuck;
+        }
+    }
+
+    const SurfaceGrid& trackGrid_; // friction and collision.
+    const LidarSensor& lidar_; // observations.
+    std::vector<Checkpoint> checkpoints_;
+
+    int numEnvs_;
+    int numCheckpoints_;
+    int maxSteps_;
+    float dt_;
+
+// Car state (struct-of-arrays).
+    std::vector<float> posX_, posY_;
+    std::vector<float> angle_, speed_;
+    std::vector<RaceState> race_;
+    std::vector<unsigned char> crossed_; // [N x numCheckpoints].
+
+    std::vector<int> episodeSteps_;
+    std::vector<float> episodeReward_;
+
+    std::vector<int> stuckCounter_;
+    std::vector<float> lastCheckX_, lastCheckY_;
+    std::vector<int> idleCounter_;
+
+// Observation blocks, [N x STATE_SIZE] each.
+    std::vector<float> obs_;
+    std::vector<float> prevObs_;
+    std::vector<float> nextObs_;
+
+    std::vector<StepResult> results_;
+    std::vector<EpisodeInfo> episodes_;
+
+    LidarBatch lidarBatch_;
+};
+
+#endif // VEC_ENV_H
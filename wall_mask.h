@@ -0,0 +1,107 @@
+#ifndef WALL_MASK_H
+#define WALL_MASK_H
+
+#include "raylib.h"
+#include "surface_grid.h"
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+// 1-bit-per-pixel wall occupancy (walls and out-of-bounds set), small enough to live in L2.
+// Pixels are packed into 8x8 tiles of one uint64_t each, and tiles are stored in Morton
+// (Z) order, so a 64-byte cache line holds a 32x16 pixel block: ray samples a few pixels
+// apart in any direction usually hit the same line. Padded by one tile (8px) of solid
+// border like SurfaceGrid, so rays need no bounds checks.
+struct WallMask {
+    static constexpr int PAD = SurfaceGrid::PAD;
+
+    int width = 0;
+    int height = 0;
+    int tilesX = 0; // tiles per padded row/column.
+    int tilesY = 0;
+    std::vector<uint64_t> tiles; // Morton-ordered.
+    std::vector<uint32_t> mortonX; // Spread(tx), per tile column.
+    std::vector<uint32_t> mortonY; // Spread(ty) << 1, per tile row.
+
+// Interleave the low 16 bits of v with zeros (bit i -> bit 2i).
+    static uint32_t Spread(uint32_t v) {
+        v &= 0xFFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    static size_t TileIndex(uint32_t tx, uint32_t ty) { return Spread(tx) | (Spread(ty) << 1); }
+
+// Tile holding padded pixel (ux, uy), and the pixel's bit within it.
+    uint64_t TileAt(uint32_t ux, uint32_t uy) const { return tiles[mortonX[ux >> 3] | mortonY[uy >> 3]]; }
+    static bool TileBit(uint64_t tile, uint32_t ux, uint32_t uy) { return (tile >> (((uy & 7) << 3) | (ux & 7))) & 1; }
+
+// x, y in [-PAD, width + PAD) x [-PAD, height + PAD).
+    bool SolidAt(int x, int y) const {
+        uint32_t ux = (uint32_t)(x + PAD);
+        uint32_t uy = (uint32_t)(y + PAD);
+        return TileBit(TileAt(ux, uy), ux, uy);
+    }
+
+    size_t Bytes() const { return tiles.size() * sizeof(uint64_t); }
+};
+
+inline WallMask BuildWallMask(const SurfaceGrid& grid) {
+    WallMask mask;
+    mask.width = grid.width;
+    mask.height = grid.height;
+    mask.tilesX = (grid.width + 2 * WallMask::PAD + 7) / 8;
+    mask.tilesY = (grid.height + 2 * WallMask::PAD + 7) / 8;
+
+// Morton indices address a power-of-two square of tiles; the unused tail stays solid.
+    int side = 1;
+    while (side < mask.tilesX || side < mask.tilesY) side *= 2;
+    mask.tiles.assign((size_t)side * side, ~0ull);
+
+    mask.mortonX.resize(mask.tilesX);
+    mask.mortonY.resize(mask.tilesY);
+    for (int tx = 0; tx < mask.tilesX; tx++) mask.mortonX[tx] = WallMask::Spread(tx);
+    for (int ty = 0; ty < mask.tilesY; ty++) mask.mortonY[ty] = WallMask::Spread(ty) << 1;
+
+    for (int ty = 0; ty < mask.tilesY; ty++) {
+        for (int tx = 0; tx < mask.tilesX; tx++) {
+            uint64_t bits = 0;
+            for (int j = 0; j < 8; j++) {
+                for (int i = 0; i < 8; i++) {
+                    int x = tx * 8 + i - WallMask::PAD;
+                    int y = ty * 8 + j - WallMask::PAD;
+                    bool solid = grid.SafeAt(x, y) >= SURFACE_WALL;
+                    if (solid) bits |= 1ull << (j * 8 + i);
+                }
+            }
+            mask.tiles[WallMask::TileIndex(tx, ty)] = bits;
+        }
+    }
+    return mask;
+}
+
+// LIDAR ray cast over the wall mask (same 2px march as the surface grid version).
+inline float CastLIDARRay(const WallMask& mask, Vector2 position, float angle, float maxDistance) {
+    float distance = 0.0f;
+    const float step = 2.0f;
+
+    const auto cosA = cos(angle);
+    const auto sinA = sin(angle);
+
+    while (distance < maxDistance) {
+        float checkX = position.x + cosA * distance;
+        float checkY = position.y + sinA * distance;
+
+        if (mask.SolidAt((int)checkX, (int)checkY)) return distance;
+
+        distance += step;
+    }
+
+    return maxDistance;
+}
+
+#endif // WALL_MASK_H